@@ -44,6 +44,7 @@
  * THE SOFTWARE.
  */
 #include "mbed.h"
+#include "us_ticker_api.h"
 #include "TextLCD.h"
 #include "TextLCD_UDC.inc"
 #include "TextLCD_UTF8.inc"
@@ -68,6 +69,75 @@ TextLCD_Base::TextLCD_Base(LCDType type, LCDCtrl ctrl) : _type(type), _ctrl(ctrl
   
   // Font table, encoded in LCDCtrl  
   _font = _ctrl & LCD_C_FNT_MSK;
+
+  // Controller select and cursor, updated by init
+  _ctrl_idx = _LCDCtrl_0;
+  _column = 0;
+  _row = 0;
+  _dl = _LCD_DL_4;
+  _bus_dl = _LCD_DL_4;
+
+  // Controller is ready, no captured bus operations
+  _busy_start = 0;
+  _busy_time = 0;
+  _ops = NULL;
+  _ops_head = 0;
+  _ops_cnt = 0;
+  _ops_max = 0;
+
+  // Bus timing estimate, updated by the bus specific constructor
+  _byte_us = 10;
+
+#if (LCD_STEP == 1)
+  // No step mode
+  _budget = 0;
+#endif
+
+#if (LCD_BUSLOCK == 1)
+  // No bus sharing
+  _lock = NULL;
+  _unlock = NULL;
+  _hold_max = LCD_BUS_HOLD;
+  _hold = false;
+  _hold_start = 0;
+#endif
+
+  // Instruction timing for the controller type
+  setTiming();
+  _cgram = false;
+  _ext_set = false;
+
+#if (LCD_TX == 1)
+  // No transaction, address unknown
+  _tx_level = 0;
+  _tx_cmd = -1;
+  _tx_len = 0;
+  _ac = -1;
+#endif
+
+#if (LCD_SHADOW == 1)
+  // Screen shadow is valid after the first cls()
+  _shadow = new char[_nr_cols * _nr_rows];
+  _shadow_ok = false;
+  _clear = ClearAuto;
+
+#if (LCD_PLAN == 1)
+  // Memory address layout of the screen for _writeCells()
+  _planSegments();
+#endif
+#endif
+}
+
+/** Destruct a TextLCD_Base interface
+  *
+  * @param  none
+  * @return none
+  */ 
+TextLCD_Base::~TextLCD_Base() {
+#if (LCD_SHADOW == 1)
+  delete[] _shadow;
+#endif
+  if (_ops != NULL) {delete[] _ops;}  // Step mode queue
 }
 
 /**  Init the LCD Controller(s)
@@ -77,19 +147,51 @@ TextLCD_Base::TextLCD_Base(LCDType type, LCDCtrl ctrl) : _type(type), _ctrl(ctrl
   */
 void TextLCD_Base::_init(_LCDDatalength dl) {
 
-  wait_ms(100);                  // Wait 100ms to ensure powered up
+  _dl = dl;                      // Save datalength for deferred init
+
+#if (LCD_GROUP == 1)
+  if (_init_defer) {
+    return;                      // Init will be done by initGroup()
+  }
+#endif
+
+  init();
+} 
+
+/** Initialise the display, includes the power-up delay and cls()
+  *  Needed for displays that were constructed with deferInit() enabled, may also be used to recover a display.
+  *  In step mode the init sequence is queued.
+  */
+void TextLCD_Base::init() {
+
+  _wait_ms(100);                 // Wait 100ms to ensure powered up
+
+  _initDisplay();
+}
+
+/**  Init all LCD Controller(s) of the display
+  *  Clear display
+  *  Note: The power-up wait is not included
+  *  @return none
+  */
+void TextLCD_Base::_initDisplay() {
+
+#if (LCD_SHADOW == 1)
+  // The display content is unknown (eg init() to recover a display), cls() must use Clear Display
+  _shadow_ok = false;
+#endif
   
 #if (LCD_TWO_CTRL == 1)
   // Select and configure second LCD controller when needed
   if(_type==LCD40x4) {
     _ctrl_idx=_LCDCtrl_1;        // Select 2nd controller   
-    _initCtrl(dl);               // Init 2nd controller   
+    _initCtrl(_dl);              // Init 2nd controller   
   }
 #endif
     
   // Select and configure primary LCD controller
   _ctrl_idx=_LCDCtrl_0;          // Select primary controller  
-  _initCtrl(dl);                 // Init primary controller
+  _initCtrl(_dl);                // Init primary controller
 
   // Clear whole display and Reset Cursor location
   // Note: This will make sure that some 3-line displays that skip topline of a 4-line configuration 
@@ -123,29 +225,38 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
                            //-------------------------------------------------------------------------------------------------                          
       _writeNibble(0x3);   //  set 8 bit mode (MSN) and dummy LSN, |   set 8 bit mode (MSN),             |    set dummy LSN, 
                            //  remains in 8 bit mode               |    remains in 4 bit mode            |  remains in 4 bit mode
-      wait_ms(15);         //                           
+      _wait_ms(15);        //                           
      
       _writeNibble(0x3);   //  set 8 bit mode (MSN) and dummy LSN, |      set dummy LSN,                 |    set 8bit mode (MSN), 
                            //  remains in 8 bit mode               |   change to 8 bit mode              |  remains in 4 bit mode
-      wait_ms(15);         // 
+      _wait_ms(15);        // 
     
       _writeNibble(0x3);   //  set 8 bit mode (MSN) and dummy LSN, | set 8 bit mode (MSN) and dummy LSN, |    set dummy LSN, 
                            //  remains in 8 bit mode               |   remains in 8 bit mode             |  change to 8 bit mode
-      wait_ms(15);         // 
+      _wait_ms(15);        // 
 
       // Controller is now in 8 bit mode
 
       _writeNibble(0x2);   // Change to 4-bit mode (MSN), the LSN is undefined dummy
-      wait_us(40);         // most instructions take 40us
+      _wait_us(40);        // most instructions take 40us
 
       // Controller is now in 4-bit mode
       // Note: 4/8 bit mode is ignored for most native SPI and I2C devices. They dont use the parallel bus.
       //       However, _writeNibble() method is void anyway for native SPI and I2C devices.
     }
     else {
+      if (_bus_dl == _LCD_DL_8) {
+        // The Controller could be in 8 bit mode (power-on reset) or in 4 bit mode (warm reboot) at this point.
+        // Two extra Function sets on the 8 bit bus make sure the Controller enters 8 bit mode in both cases.
+        _writeCommand(0x30); // Function set 0 0 1 DL=1 N F x x       
+        _wait_ms(15);        //                           
+        _writeCommand(0x30); // Function set 0 0 1 DL=1 N F x x       
+        _wait_ms(15);        //                           
+      }
+
       // Reset in 8 bit mode, final Function set will follow 
       _writeCommand(0x30); // Function set 0 0 1 DL=1 N F x x       
-      wait_ms(1);          // most instructions take 40us      
+      _wait_ms(1);         // most instructions take 40us      
     }      
    
     // Device specific initialisations: DC/DC converter to generate VLCD or VLED, number of lines etc
@@ -399,7 +510,7 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
             case LCD16x1:                                            
 //            case LCD20x1:                    
             case LCD24x1:
-              _function = 0x00;       // FUNCTION SET 0 0 1 DL=0 (4 bit), N=0 (1-line display mode), F=0 (5*7dot), 0, IS
+              _function = _bus_dl | 0x00;       // FUNCTION SET 0 0 1 DL=0 (4 bit), N=0 (1-line display mode), F=0 (5*7dot), 0, IS
                                       // Note: 4 bit mode is ignored for native SPI and I2C devices
                                       // Saved to allow switch between Instruction sets at later time
               break;  
@@ -414,7 +525,7 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
 
             default:
               // All other LCD types are initialised as 2 Line displays        
-              _function = 0x08;       // FUNCTION SET 0 0 1 DL=0 (4 bit), N=1 (2-line display mode), F=0 (5*7dot), 0, IS              
+              _function = _bus_dl | 0x08;       // FUNCTION SET 0 0 1 DL=0 (4 bit), N=1 (2-line display mode), F=0 (5*7dot), 0, IS              
                                       // Note: 4 bit mode is ignored for native SPI and I2C devices
                                       // Saved to allow switch between Instruction sets at later time
               break;                                                                        
@@ -442,10 +553,10 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
                                                             // Saved to allow contrast change at later time
           }
           _writeCommand(0x50 | _icon_power | ((_contrast >> 4) & 0x03));  // Set Icon, Booster and Contrast High bits, 0 1 0 1 Ion Bon C5 C4 (IS=1)
-          wait_ms(10);            // Wait 10ms to ensure powered up
+          _wait_us(_timing.extended); // Wait to ensure powered up
           
           _writeCommand(0x68 | (LCD_ST7032_RAB & 0x07));      // Voltage follower, 0 1 1 0 FOn=1, Ampl ratio Rab2=1, Rab1=0, Rab0=0  (IS=1)
-          wait_ms(10);            // Wait 10ms to ensure powered up
+          _wait_us(_timing.extended); // Wait to ensure powered up
           
           _writeCommand(0x20 | _function);                  // Select Instruction Set = 0
 
@@ -466,7 +577,7 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
 //            case LCD12x1:                                
             case LCD16x1:   
             case LCD24x1:                                                                         
-              _function = 0x00;     // Set function, 0 0 1 DL=0 (4-bit Databus), N=0 (1 Line), DH=0 (5x7font), IS2, IS1 (Select Instruction Set)
+              _function = _bus_dl | 0x00;     // Set function, 0 0 1 DL=0 (4-bit Databus), N=0 (1 Line), DH=0 (5x7font), IS2, IS1 (Select Instruction Set)
                                     // Note: 4 bit mode is ignored for native SPI and I2C devices
                                     // Saved to allow switch between Instruction sets at later time
               
@@ -475,7 +586,7 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
 
 //            case LCD12x3G:          // Special mode for ST7036
             case LCD16x3G:          // Special mode for ST7036
-              _function = 0x08;     // Set function, 0 0 1 DL=0 (4-bit Databus), N=1 (2 Line), DH=0 (5x7font), IS2,IS1 (Select Instruction Set)              
+              _function = _bus_dl | 0x08;     // Set function, 0 0 1 DL=0 (4-bit Databus), N=1 (2 Line), DH=0 (5x7font), IS2,IS1 (Select Instruction Set)              
                                     // Note: 4 bit mode is ignored for native SPI and I2C devices
                                     // Saved to allow switch between Instruction sets at later time
               
@@ -491,7 +602,7 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
 
             default:
               // All other LCD types are initialised as 2 Line displays (including LCD16x1C and LCD40x4)       
-              _function = 0x08;     // Set function, 0 0 1 DL=0 (4-bit Databus), N=1 (2 Line), DH=0 (5x7font), IS2,IS1 (Select Instruction Set)
+              _function = _bus_dl | 0x08;     // Set function, 0 0 1 DL=0 (4-bit Databus), N=1 (2 Line), DH=0 (5x7font), IS2,IS1 (Select Instruction Set)
                                     // Note: 4 bit mode is ignored for native SPI and I2C devices
                                     // Saved to allow switch between Instruction sets at later time
               
@@ -518,10 +629,10 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
           }
           
           _writeCommand(0x50 | _icon_power | ((_contrast >> 4) & 0x03));   // Set Contrast C5, C4 (Instr Set 1)
-          wait_ms(10);            // Wait 10ms to ensure powered up
+          _wait_us(_timing.extended); // Wait to ensure powered up
 
           _writeCommand(0x68 | (LCD_ST7036_RAB & 0x07));  // Voltagefollower On = 1, Ampl ratio Rab2, Rab1, Rab0 = 1 0 1 (Instr Set 1)
-          wait_ms(10);            // Wait 10ms to ensure powered up
+          _wait_us(_timing.extended); // Wait to ensure powered up
 
           _writeCommand(0x20 | _function);          // Set function, IS2,IS1 = 00 (Select Instruction Set = 0)
          
@@ -586,7 +697,7 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
 //            case LCD12x1:                                
             case LCD16x1:   
             case LCD24x1:                                                                         
-              _function = 0x00;     //  Set function 0 0 1 DL N DH RE(0) IS 
+              _function = _bus_dl | 0x00;     //  Set function 0 0 1 DL N DH RE(0) IS 
                                     //  Saved to allow switch between Instruction sets at later time
                                     //    DL=0 4-bit Databus,
                                     //         Note: 4 bit mode is ignored for native SPI and I2C devices
@@ -594,7 +705,7 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
                                     //    DH=0 Double Height disable 
                                     //    IS=0
           
-              _function_1 = 0x02;   // Set function, 0 0 1 DL N BE RE(1) REV
+              _function_1 = _bus_dl | 0x02;   // Set function, 0 0 1 DL N BE RE(1) REV
                                     //  Saved to allow switch between Instruction sets at later time
                                     //    DL=0 4-bit Databus,
                                     //         Note: 4 bit mode is ignored for native SPI and I2C devices
@@ -611,7 +722,7 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
             case LCD16x3D:          // Special mode for KS0078
 //            case LCD16x3D1:           // Special mode for SSD1803
 //            case LCD20x3D:            // Special mode for SSD1803
-              _function = 0x00;     //  Set function 0 0 1 DL N DH RE(0) IS 
+              _function = _bus_dl | 0x00;     //  Set function 0 0 1 DL N DH RE(0) IS 
                                     //  Saved to allow switch between Instruction sets at later time
                                     //    DL=0 4-bit Databus,
                                     //         Note: 4 bit mode is ignored for native SPI and I2C devices
@@ -619,7 +730,7 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
                                     //    DH=0 Double Height disable 
                                     //    IS=0
           
-              _function_1 = 0x02;   // Set function, 0 0 1 DL N BE RE(1) REV
+              _function_1 = _bus_dl | 0x02;   // Set function, 0 0 1 DL N BE RE(1) REV
                                     //  Saved to allow switch between Instruction sets at later time
                                     //    DL=0 4-bit Databus,
                                     //         Note: 4 bit mode is ignored for native SPI and I2C devices
@@ -634,7 +745,7 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
 //            case LCD10x2D:          // Special mode for SSD1803, 4-line mode but switch to double height font
             case LCD10x4D:          // Special mode for SSD1803
             case LCD20x4D:          // Special mode for SSD1803
-              _function = 0x08;     //  Set function 0 0 1 DL N DH RE(0) IS 
+              _function = _bus_dl | 0x08;     //  Set function 0 0 1 DL N DH RE(0) IS 
                                     //  Saved to allow switch between Instruction sets at later time
                                     //    DL=0 4-bit Databus,
                                     //         Note: 4 bit mode is ignored for native SPI and I2C devices
@@ -642,7 +753,7 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
                                     //    DH=0 Double Height disable 
                                     //    IS=0
           
-              _function_1 = 0x0A;   // Set function, 0 0 1 DL N BE RE(1) REV
+              _function_1 = _bus_dl | 0x0A;   // Set function, 0 0 1 DL N BE RE(1) REV
                                     //  Saved to allow switch between Instruction sets at later time
                                     //    DL=0 4-bit Databus,
                                     //         Note: 4 bit mode is ignored for native SPI and I2C devices
@@ -661,7 +772,7 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
 
             default:
               // All other LCD types are initialised as 2 Line displays (including LCD16x1C and LCD40x4)       
-              _function = 0x08;     //  Set function 0 0 1 DL N DH RE(0) IS 
+              _function = _bus_dl | 0x08;     //  Set function 0 0 1 DL N DH RE(0) IS 
                                     //  Saved to allow switch between Instruction sets at later time
                                     //    DL=0 4-bit Databus,
                                     //         Note: 4 bit mode is ignored for native SPI and I2C devices
@@ -670,7 +781,7 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
                                     //    RE=0
                                     //    IS=0
           
-              _function_1 = 0x0A;   // Set function, 0 0 1 DL N BE RE(1) REV
+              _function_1 = _bus_dl | 0x0A;   // Set function, 0 0 1 DL N BE RE(1) REV
                                     //  Saved to allow switch between Instruction sets at later time
                                     //    DL=0 4-bit Databus,
                                     //         Note: 4 bit mode is ignored for native SPI and I2C devices
@@ -691,7 +802,7 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
           
           _writeCommand(0x06);                      // Set ext entry mode, 0 0 0 0 0 1 BDC=1 COM1-32, BDS=0 SEG100-1    "Bottom View" (Ext Instr Set)
 //          _writeCommand(0x05);                      // Set ext entry mode, 0 0 0 0 0 1 BDC=0 COM32-1, BDS=1 SEG1-100    "Top View" (Ext Instr Set)          
-          wait_ms(5);                               // Wait to ensure completion or SSD1803 fails to set Top/Bottom after reset..
+          _wait_us(_timing.extended);                // Wait to ensure completion or SSD1803 fails to set Top/Bottom after reset..
          
           _writeCommand(0x08 | _lines);             // Set ext function 0 0 0 0 1 FW BW NW 1,2,3 or 4 lines (Ext Instr Set)
 
@@ -710,10 +821,10 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
           _icon_power = 0x0C;                       // Icon on, Booster on (Instr Set 1)          
                                                     // Saved to allow contrast change at later time
           _writeCommand(0x50 | _icon_power | ((_contrast >> 4) & 0x03));   // Set Power, Icon and Contrast, 0 1 0 1 Ion Bon C5 C4 (Instr Set 1)
-          wait_ms(10);            // Wait 10ms to ensure powered up
+          _wait_us(_timing.extended); // Wait to ensure powered up
 
           _writeCommand(0x68 | (LCD_SSD1_RAB & 0x07));  // Set Voltagefollower 0 1 1 0 Don = 1, Ampl ratio Rab2, Rab1, Rab0 = 1 1 0  (Instr Set 1)
-          wait_ms(10);            // Wait 10ms to ensure powered up
+          _wait_us(_timing.extended); // Wait to ensure powered up
 
           _writeCommand(0x20 | _function_1);        // Set function, 0 0 1 DL N BE RE(1) REV 
                                                     // Select Extended Instruction Set 1
@@ -744,13 +855,13 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
           // Initialise Display configuration
           switch (_type) {
             case LCD24x1:                    
-              _function = 0x00;       //FUNCTION SET 0 0 1 DL=0 4-bit, 0, M=0 1-line/24 chars display mode, 0, H=0 
+              _function = _bus_dl | 0x00;       //FUNCTION SET 0 0 1 DL=0 4-bit, 0, M=0 1-line/24 chars display mode, 0, H=0 
                                       //Note: 4 bit mode is ignored for I2C mode
               break;  
 
 //            case LCD12x1D:            //Special mode for PCF21XX, Only top line used
             case LCD12x2:
-              _function = 0x04;       //FUNCTION SET 0 0 1 DL=0 4-bit, 0, M=1 2-line/12 chars display mode, 0, H=0
+              _function = _bus_dl | 0x04;       //FUNCTION SET 0 0 1 DL=0 4-bit, 0, M=1 2-line/12 chars display mode, 0, H=0
                                       //Note: 4 bit mode is ignored for I2C mode
               break;  
               
@@ -761,7 +872,7 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
           } // switch type    
 
           _writeCommand(0x20 | _function | 0x01);          // Set function, Select Instr Set = 1              
-          wait_ms(10);            // Wait 10ms to ensure powered up                                                    
+          _wait_us(_timing.extended); // Wait to ensure powered up                                                    
 
 // Note: Display from GA628 shows 12 chars. This is actually the right half of a 24x1 display. The commons have been connected in reverse order.
           _writeCommand(0x05);                             // Display Conf Set         0000 0, 1, P=0, Q=1               (Instr. Set 1)
@@ -792,12 +903,12 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
 //              _function = 0x02;       // FUNCTION SET 0 0 1 DL=0 4 bit, 0, M=0 1-line/12 chars display mode, SL=1, IS=0
                                       // Note: 4 bit mode is ignored for I2C mode
             case LCD24x1:                    
-              _function = 0x00;       // FUNCTION SET 0 0 1 DL=0 4 bit, 0, M=0 1-line/24 chars display mode, SL=0, IS=0            
+              _function = _bus_dl | 0x00;       // FUNCTION SET 0 0 1 DL=0 4 bit, 0, M=0 1-line/24 chars display mode, SL=0, IS=0            
                                       // Note: 4 bit mode is ignored for I2C mode
               break;  
 
             case LCD12x2:                    
-              _function = 0x04;       // FUNCTION SET 0 0 1 DL=0 4 bit, 0, M=1 2-line/12 chars display mode, SL=0, IS=0            
+              _function = _bus_dl | 0x04;       // FUNCTION SET 0 0 1 DL=0 4 bit, 0, M=1 2-line/12 chars display mode, SL=0, IS=0            
               break;  
              
             default:
@@ -817,7 +928,7 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
           _contrast = LCD_PCF2_CONTRAST;              
           _writeCommand(0x80 | 0x00 | (_contrast & 0x3F));      // VLCD_set (Instr. Set 1)  1, V=0, VA=contrast
           _writeCommand(0x80 | 0x40 | (_contrast & 0x3F));      // VLCD_set (Instr. Set 1)  1, V=1, VB=contrast
-          wait_ms(10);            // Wait 10ms to ensure powered up
+          _wait_us(_timing.extended); // Wait to ensure powered up
           
           _writeCommand(0x02);                             // Screen Config            0000 001, L=0  (Instr. Set 1)
           _writeCommand(0x08);                             // ICON Conf                0000 1, IM=0 (Char mode), IB=0 (no icon blink) DM=0 (no direct mode) (Instr. Set 1) 
@@ -839,23 +950,23 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
 //            case LCD12x1:
 //            case LCD12x2:                                                                            
             case LCD24x1:                    
-              _writeCommand(0x22);    //FUNCTION SET 0 0 1 DL=0 4-bit, N=0/M=0 1-line/24 chars display mode, G=1 Vgen on, 0 
+              _writeCommand(0x22 | _bus_dl);  //FUNCTION SET 0 0 1 DL=0 4-bit, N=0/M=0 1-line/24 chars display mode, G=1 Vgen on, 0 
                                       //Note: 4 bit mode is ignored for I2C mode
-              wait_ms(10);            // Wait 10ms to ensure powered up                                                    
+              _wait_us(_timing.extended); // Wait to ensure powered up                                                    
               break;  
 
             case LCD12x3D:            // Special mode for KS0078 and PCF21XX                            
             case LCD12x3D1:           // Special mode for PCF21XX                     
             case LCD12x4D:            // Special mode for PCF21XX:
-              _writeCommand(0x2E);    //FUNCTION SET 0 0 1 DL=0 4-bit, N=1/M=1 4-line/12 chars display mode, G=1 VGen on, 0                               
+              _writeCommand(0x2E | _bus_dl);  //FUNCTION SET 0 0 1 DL=0 4-bit, N=1/M=1 4-line/12 chars display mode, G=1 VGen on, 0                               
                                       //Note: 4 bit mode is ignored for I2C mode              
-              wait_ms(10);            // Wait 10ms to ensure powered up                                                    
+              _wait_us(_timing.extended); // Wait to ensure powered up                                                    
               break;  
 
             case LCD24x2:
-              _writeCommand(0x2A);    //FUNCTION SET 0 0 1 DL=0 4-bit, N=1/M=0 2-line/24 chars display mode, G=1 VGen on, 0
+              _writeCommand(0x2A | _bus_dl);  //FUNCTION SET 0 0 1 DL=0 4-bit, N=1/M=0 2-line/24 chars display mode, G=1 VGen on, 0
                                       //Note: 4 bit mode is ignored for I2C mode
-              wait_ms(10);            // Wait 10ms to ensure powered up   
+              _wait_us(_timing.extended); // Wait to ensure powered up   
               break;  
               
             default:
@@ -886,9 +997,9 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
             case LCD12x4D:            // Special mode for PCF21XX:
 //              _writeCommand(0x34);    //FUNCTION SET 8 bit, N=0/M=1 4-line/12 chars display mode      OK
 //              _writeCommand(0x24);    //FUNCTION SET 4 bit, N=0/M=1 4-line/12 chars display mode      OK                                            
-              _writeCommand(0x2C);    //FUNCTION SET 0 0 1 DL=0 4-bit, N=1/M=1 4-line/12 chars display mode, G=0 no Vgen, 0  OK       
+              _writeCommand(0x2C | _bus_dl);  //FUNCTION SET 0 0 1 DL=0 4-bit, N=1/M=1 4-line/12 chars display mode, G=0 no Vgen, 0  OK       
                                       //Note: 4 bit mode is ignored for I2C mode              
-              wait_ms(10);            // Wait 10ms to ensure powered up                                                    
+              _wait_us(_timing.extended); // Wait to ensure powered up                                                    
               break;  
 
 //            case LCD24x2:
@@ -912,27 +1023,27 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
           // Note2: Vgen is switched off when the contrast voltage VA or VB is set to 0x00.
                   
 //POR or Hardware Reset should be applied
-          wait_ms(10);            // Wait 10ms to ensure powered up   
+          _wait_us(_timing.extended); // Wait to ensure powered up   
 
           // Initialise Display configuration
           switch (_type) {
             case LCD8x1:
 //            case LCD12x1:
             case LCD16x1:           
-              _function = 0x02;       // FUNCTION SET 0 0 1 DL=0 4-bit, 0 , M=0 1-line/16 chars display mode, SL=1
+              _function = _bus_dl | 0x02;       // FUNCTION SET 0 0 1 DL=0 4-bit, 0 , M=0 1-line/16 chars display mode, SL=1
                                       // Note: 4 bit mode is ignored for I2C mode
               break;  
             
             case LCD24x1:                    
 //            case LCD32x1:                                
-              _function = 0x00;       // FUNCTION SET 0 0 1 DL=0 4-bit, 0 , M=0 1-line/32 chars display mode, SL=0
+              _function = _bus_dl | 0x00;       // FUNCTION SET 0 0 1 DL=0 4-bit, 0 , M=0 1-line/32 chars display mode, SL=0
                                       // Note: 4 bit mode is ignored for I2C mode
               break;  
 
             case LCD8x2:
 //            case LCD12x2:            
             case LCD16x2:
-              _function = 0x04;       // FUNCTION SET 0 0 1 DL=0 4-bit, 0, M=1 2-line/16 chars display mode, SL=0
+              _function = _bus_dl | 0x04;       // FUNCTION SET 0 0 1 DL=0 4-bit, 0, M=1 2-line/16 chars display mode, SL=0
                                       // Note: 4 bit mode is ignored for I2C mode
               break;  
              
@@ -957,7 +1068,7 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
           _contrast = LCD_PCF2_CONTRAST;              
           _writeCommand(0x80 | 0x00 | (_contrast & 0x3F));      // VLCD_set (Instr. Set 1)    V=0, VA=contrast
           _writeCommand(0x80 | 0x40 | (_contrast & 0x3F));      // VLCD_set (Instr. Set 1)    V=1, VB=contrast
-          wait_ms(10);            // Wait 10ms to ensure powered up
+          _wait_us(_timing.extended); // Wait to ensure powered up
           
           _writeCommand(0x02);    // SCRN CONF (Instr. Set 1)    L=0
           _writeCommand(0x08);    // ICON CONF (Instr. Set 1)    IM=0 (Char mode) IB=0 (no icon blink) DM=0 (no direct mode)
@@ -987,7 +1098,7 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
           //_writeCommand(0x13);   // Char mode, DC/DC off              
           //wait_ms(10);           // Wait 10ms to ensure powered down                  
           _writeCommand(0x17);   // Char mode, DC/DC on        
-          wait_ms(10);           // Wait 10ms to ensure powered up        
+          _wait_us(_timing.extended); // Wait to ensure powered up        
 
           // Initialise Display configuration
           switch (_type) {                    
@@ -996,7 +1107,7 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
 //            case LCD12x1:                                
             case LCD16x1:                                            
             case LCD24x1:
-              _writeCommand(0x20); // Function set 001 DL N F FT1 FT0
+              _writeCommand(0x20 | _bus_dl); // Function set 001 DL N F FT1 FT0
                                    //  DL=0  (4 bits bus)             
                                    //   N=0  (1 line)
                                    //   F=0  (5x7 dots font)
@@ -1013,7 +1124,7 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
 
             default:
               // All other LCD types are initialised as 2 Line displays (including LCD16x1C and LCD40x4)       
-              _writeCommand(0x28); // Function set 001 DL N F FT1 FT0
+              _writeCommand(0x28 | _bus_dl); // Function set 001 DL N F FT1 FT0
                                    //  DL=0  (4 bits bus)
                                    //   N=1  (2 lines)
                                    //   F=0  (5x7 dots font)
@@ -1038,14 +1149,14 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
 //            case LCD12x1:                                
             case LCD16x1:   
 //            case LCD20x1:                                                                         
-              _function = 0x00;     //  Set function 0 0 1 X N DH RE(0) IS 
+              _function = _bus_dl | 0x00;     //  Set function 0 0 1 X N DH RE(0) IS 
                                     //  Saved to allow switch between Instruction sets at later time
                                     //    DL=X bit is ignored for US2066. Uses hardwired pins instead
                                     //     N=0 1 Line / 3 Line
                                     //    DH=0 Double Height disable 
                                     //    IS=0
           
-              _function_1 = 0x02;   // Set function, 0 0 1 X N BE RE(1) REV
+              _function_1 = _bus_dl | 0x02;   // Set function, 0 0 1 X N BE RE(1) REV
                                     //  Saved to allow switch between Instruction sets at later time
                                     //    DL=X bit is ignored for US2066. Uses hardwired pins instead                                    
                                     //     N=0 1 Line / 3 Line
@@ -1060,14 +1171,14 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
             case LCD8x2:
             case LCD16x2:
             case LCD20x2:            
-              _function = 0x08;     //  Set function 0 0 1 X N DH RE(0) IS 
+              _function = _bus_dl | 0x08;     //  Set function 0 0 1 X N DH RE(0) IS 
                                     //  Saved to allow switch between Instruction sets at later time
                                     //    DL=X bit is ignored for US2066. Uses hardwired pins instead                                                                        
                                     //     N=1 2 line / 4 Line
                                     //    DH=0 Double Height disable 
                                     //    IS=0
           
-              _function_1 = 0x0A;   // Set function, 0 0 1 X N BE RE(1) REV
+              _function_1 = _bus_dl | 0x0A;   // Set function, 0 0 1 X N BE RE(1) REV
                                     //  Saved to allow switch between Instruction sets at later time
                                     //    DL=X bit is ignored for US2066. Uses hardwired pins instead                                                                        
                                     //     N=1 2 line / 4 Line
@@ -1083,14 +1194,14 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
             case LCD16x3D:          // Special mode for KS0078, SSD1803 and US2066
 //            case LCD16x3D1:           // Special mode for SSD1803, US2066
 //            case LCD20x3D:            // Special mode for SSD1803, US2066
-              _function = 0x00;     //  Set function 0 0 1 X N DH RE(0) IS 
+              _function = _bus_dl | 0x00;     //  Set function 0 0 1 X N DH RE(0) IS 
                                     //  Saved to allow switch between Instruction sets at later time
                                     //    DL=X bit is ignored for US2066. Uses hardwired pins instead                                    
                                     //     N=0 1 Line / 3 Line
                                     //    DH=0 Double Height disable 
                                     //    IS=0
           
-              _function_1 = 0x02;   // Set function, 0 0 1 X N BE RE(1) REV
+              _function_1 = _bus_dl | 0x02;   // Set function, 0 0 1 X N BE RE(1) REV
                                     //  Saved to allow switch between Instruction sets at later time
                                     //    DL=X bit is ignored for US2066. Uses hardwired pins instead                                    
                                     //     N=0 1 Line / 3 Line
@@ -1102,14 +1213,14 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
               break;  
 
             case LCD20x4D:          // Special mode for SSD1803, US2066
-              _function = 0x08;     //  Set function 0 0 1 X N DH RE(0) IS 
+              _function = _bus_dl | 0x08;     //  Set function 0 0 1 X N DH RE(0) IS 
                                     //  Saved to allow switch between Instruction sets at later time
                                     //    DL=X bit is ignored for US2066. Uses hardwired pins instead
                                     //     N=1 2 line / 4 Line
                                     //    DH=0 Double Height disable 
                                     //    IS=0
           
-              _function_1 = 0x0A;   // Set function, 0 0 1 DL N BE RE(1) REV
+              _function_1 = _bus_dl | 0x0A;   // Set function, 0 0 1 DL N BE RE(1) REV
                                     //  Saved to allow switch between Instruction sets at later time
                                     //    DL=0 bit is ignored for US2066. Uses hardwired pins instead                                    
                                     //     N=1 2 line / 4 Line
@@ -1175,7 +1286,7 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
           _writeCommand(0xDB);                      // Set VCOMH Deselect Lvl: 1 1 0 1 1 0 1 1 (Ext Instr Set, OLED)
           _writeCommand(0x30);                      // Set VCOMH Deselect Value: 0.83 x VCC
 
-          wait_ms(10);            // Wait 10ms to ensure powered up
+          _wait_us(_timing.extended); // Wait to ensure powered up
 
 //Test Fade/Blinking. Hard Blink on/off, No fade in/out ??
 //          _writeCommand(0x23);                      // Set (Ext Instr Set, OLED)
@@ -1205,7 +1316,7 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
             case LCD16x1:                                            
             case LCD20x1:                                                        
             case LCD24x1:
-              _function = 0x00;    // Function set 001 DL N X BR1 BR0
+              _function = _bus_dl | 0x00;    // Function set 001 DL N X BR1 BR0
                                    //  DL=0 (4 bits bus)
                                    //  Note: 4 bit mode is ignored for native SPI and I2C devices                                                                                 
                                    //  N=0 (1 line)
@@ -1224,7 +1335,7 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
             case LCD16x2:  
             case LCD20x2:
             case LCD24x2:
-              _function = 0x08;    // Function set 001 DL N X BR1 BR2
+              _function = _bus_dl | 0x08;    // Function set 001 DL N X BR1 BR2
                                    //  DL=0 (4 bits bus)
                                    //  Note: 4 bit mode is ignored for native SPI and I2C devices                                 
                                    //  N=1 (2 lines)
@@ -1252,13 +1363,13 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
             case LCD20x1:
             case LCD24x1:
 //            case LCD32x1:        // EXT pin is High, extension driver needed
-              _function  = 0x02;    // Function set 001 DL N RE(0) - - (Std Regs)
+              _function  = _bus_dl | 0x02;    // Function set 001 DL N RE(0) - - (Std Regs)
                                     //   DL=0  (4 bits bus)             
                                     //    N=0  (1-line mode, N=1 2-line mode)
                                     //   RE=0  (Dis. Extended Regs, special mode for HD66712)
                                     //   
                                     
-              _function_1 = 0x04;   // Function set 001 DL N RE(1) BE LP (Ext Regs)
+              _function_1 = _bus_dl | 0x04;   // Function set 001 DL N RE(1) BE LP (Ext Regs)
                                     //   DL=0  (4 bits bus)             
                                     //    N=0  (1-line mode, N=1 2-line mode)
                                     //   RE=1  (Ena Extended Regs; special mode for HD66712)
@@ -1275,13 +1386,13 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
 //            case LCD16x3D:         // Special mode for KS0073, KS0078 and HD66712
 //            case LCD16x4D:         // Special mode for KS0073, KS0078 and HD66712            
             case LCD20x4D:         // Special mode for KS0073, KS0078 and HD66712            
-              _function  = 0x02;    // Function set 001 DL N RE(0) - - (Std Regs)
+              _function  = _bus_dl | 0x02;    // Function set 001 DL N RE(0) - - (Std Regs)
                                     //   DL=0  (4 bits bus)             
                                     //    N=0  (1-line mode, N=1 2-line mode)
                                     //   RE=0  (Dis. Extended Regs, special mode for HD66712)
                                     //   
                                     
-              _function_1 = 0x04;   // Function set 001 DL N RE(1) BE LP (Ext Regs)
+              _function_1 = _bus_dl | 0x04;   // Function set 001 DL N RE(1) BE LP (Ext Regs)
                                     //   DL=0  (4 bits bus)             
                                     //    N=0  (1-line mode, N=1 2-line mode)
                                     //   RE=1  (Ena Extended Regs; special mode for HD66712)
@@ -1301,12 +1412,12 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
 
             default:
               // All other LCD types are initialised as 2 Line displays (including LCD16x1C and LCD40x4)            
-              _function  = 0x0A;    // Function set 001 DL N RE(0) - - (Std Regs)
+              _function  = _bus_dl | 0x0A;    // Function set 001 DL N RE(0) - - (Std Regs)
                                     //   DL=0  (4 bits bus)             
                                     //    N=1  (2-line mode), N=0 (1-line mode)
                                     //   RE=0  (Dis. Extended Regs, special mode for HD66712)
                                     
-              _function_1 = 0x0C;   // Function set 001 DL N RE(1) BE LP (Ext Regs)
+              _function_1 = _bus_dl | 0x0C;   // Function set 001 DL N RE(1) BE LP (Ext Regs)
                                     //   DL=0  (4 bits bus)             
                                     //    N=1  (2 line mode), N=0 (1-line mode)
                                     //   RE=1  (Ena Extended Regs, special mode for HD66712)
@@ -1357,7 +1468,7 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
             case LCD16x1:                                            
 //            case LCD20x1:                    
             case LCD24x1:
-              _function = 0x00;       // FUNCTION SET 0 0 1 DL=0 (4 bit), N=0 (1-line display mode), F=0 (5*7dot), 0, IS
+              _function = _bus_dl | 0x00;       // FUNCTION SET 0 0 1 DL=0 (4 bit), N=0 (1-line display mode), F=0 (5*7dot), 0, IS
                                       // Note: 4 bit mode is ignored for native SPI and I2C devices
                                       // Saved to allow switch between Instruction sets at later time
               break;  
@@ -1372,7 +1483,7 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
 
             default:
               // All other LCD types are initialised as 2 Line displays        
-              _function = 0x08;       // FUNCTION SET 0 0 1 DL=0 (4 bit), N=1 (2-line display mode), F=0 (5*7dot), 0, IS              
+              _function = _bus_dl | 0x08;       // FUNCTION SET 0 0 1 DL=0 (4 bit), N=1 (2-line display mode), F=0 (5*7dot), 0, IS              
                                       // Note: 4 bit mode is ignored for native SPI and I2C devices
                                       // Saved to allow switch between Instruction sets at later time
               break;                                                                        
@@ -1394,11 +1505,11 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
                                                             // Saved to allow contrast change at later time
 
           _writeCommand(0x50 | _icon_power | ((_contrast >> 4) & 0x03));  // Set Icon, Booster and Contrast High bits, 0 1 0 1 Ion Bon C5 C4 (IS=1)
-          wait_ms(10);            // Wait 10ms to ensure powered up
+          _wait_us(_timing.extended); // Wait to ensure powered up
           
           _writeCommand(0x68 | (LCD_SPLC792A_RAB & 0x07));  // Voltage follower, 0 1 1 0 FOn=1, Ampl ratio Rab2=1, Rab1=0, Rab0=0  (IS=1)
                                                             // Note: Follower circuit always on for SPLC792A, Bit3 is dont care          
-          wait_ms(10);            // Wait 10ms to ensure powered up
+          _wait_us(_timing.extended); // Wait to ensure powered up
           
           _writeCommand(0x20 | _function);                  // Select Instruction Set = 0
 
@@ -1417,8 +1528,8 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
 //            case LCD20x1:                                                        
             case LCD24x1:
 //            case LCD40x1:            
-              _function = 0x00;    // Function set 001 DL N F - -
-                                   //  DL=0 (4 bits bus)             
+              _function = _bus_dl | 0x00; // Function set 001 DL N F - -
+                                   //  DL=0 (4 bits bus), DL=1 for 8 bit expanders
                                    //   N=0 (1 line)
                                    //   F=0 (5x7 dots font)
               break;                                
@@ -1436,8 +1547,8 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
 
             // All other LCD types are initialised as 2 Line displays (including LCD16x1C and LCD40x4)
             default:
-              _function = 0x08;    // Function set 001 DL N F - -
-                                   //  DL=0 (4 bits bus)
+              _function = _bus_dl | 0x08; // Function set 001 DL N F - -
+                                   //  DL=0 (4 bits bus), DL=1 for 8 bit expanders
                                    //  Note: 4 bit mode is ignored for native SPI and I2C devices                                 
                                    //   N=1 (2 lines)
                                    //   F=0 (5x7 dots font, only option for 2 line display)
@@ -1456,8 +1567,7 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
 //                         // Since we are not using the Busy flag, Lets be safe and take 10 ms  
 
     _writeCommand(0x02); // Cursor Home, DDRAM Address to Origin
-    wait_ms(10);         // The Return Home command takes 1.64 ms.
-                         // Since we are not using the Busy flag, Lets be safe and take 10 ms      
+                         // The Return Home command takes 1.64 ms on HD44780, the wait is selected from the timing table
 
     _writeCommand(0x06); // Entry Mode 0000 0 1 I/D S 
                          //   Cursor Direction and Display Shift
@@ -1484,6 +1594,18 @@ void TextLCD_Base::_initCtrl(_LCDDatalength dl) {
   */
 void TextLCD_Base::cls() {
 
+#if (LCD_SHADOW == 1)
+  // Overwrite only the non-blank characters when that is faster than the Clear Display instruction 
+  if (_shadow_ok && ((_clear == ClearFill) || ((_clear == ClearAuto) && (_fillCost() < _clearCost())))) {
+    _column = 0;  // Cursor location is restored by _writeCells()  
+    _row = 0;
+    if (_writeCells(0, NULL, _nr_cols * _nr_rows) == 0) {
+      setAddress(0, 0);  // Screen was already blank, Reset Cursor location
+    }
+    return;
+  }
+#endif
+
 #if (LCD_TWO_CTRL == 1)
   // Select and configure second LCD controller when needed
   if(_type==LCD40x4) {
@@ -1494,8 +1616,7 @@ void TextLCD_Base::cls() {
 
     // Second LCD controller Clearscreen
     _writeCommand(0x01);  // cls, and set cursor to 0    
-    wait_ms(20);          // The CLS command takes 1.64 ms.
-                          // Since we are not using the Busy flag, Lets be safe and take 10 ms
+                          // The CLS command takes 1.64 ms on HD44780, the wait is selected from the timing table
   
     _ctrl_idx=_LCDCtrl_0; // Select primary controller
   }
@@ -1503,8 +1624,7 @@ void TextLCD_Base::cls() {
   
   // Primary LCD controller Clearscreen
   _writeCommand(0x01);    // cls, and set cursor to 0
-  wait_ms(20);            // The CLS command takes 1.64 ms.
-                          // Since we are not using the Busy flag, Lets be safe and take 10 ms
+                          // The CLS command takes 1.64 ms on HD44780, the wait is selected from the timing table
 
   // Restore cursormode on primary LCD controller when needed
   if(_type==LCD40x4) {
@@ -1514,12 +1634,305 @@ void TextLCD_Base::cls() {
 #else
   // Support only one LCD controller
   _writeCommand(0x01);    // cls, and set cursor to 0
-  wait_ms(20);            // The CLS command takes 1.64 ms.
-                          // Since we are not using the Busy flag, Lets be safe and take 10 ms
+                          // The CLS command takes 1.64 ms on HD44780, the wait is selected from the timing table
+#endif
+
+#if (LCD_SHADOW == 1)
+  // The whole display is now initialised to charcode 0x20
+  memset(_shadow, ' ', _nr_cols * _nr_rows);
+  _shadow_ok = true;
+#endif
+
+  // Reset Cursor location
+  // Note: The Clear Display instruction already sets memory address 0. Skipping the address command
+  //       allows cls() to return while the controller is still busy, the next write will wait for completion.
+  //       The address command is still needed for displays that don't use address 0 for the first location
+  //       (eg PCF21XX does not use line 0 in the '3 Line' mode).
+  _column = 0;
+  _row = 0;
+  if (getAddress(0, 0) != 0) {
+    setAddress(0, 0);
+  }
+}
+
+#if (LCD_SHADOW == 1)
+/** Set the method used by cls()
+  *  ClearFill overwrites only the non-blank characters with spaces, this is faster on partially filled screens
+  *  and slow busses. ClearAuto selects the fastest method for the current bus and screen content.
+  *
+  * @param LCDClear clearMode  The Clear method (ClearAuto, ClearCmd, ClearFill)
+  * @return none
+  */
+void TextLCD_Base::setClearMode(LCDClear clearMode) {
+  _clear = clearMode;
+}
+
+/** Update characters on the display
+  * Only the characters that differ from the screen shadow are written. The cursor location is restored.
+  *
+  * @param int pos            First character location in the screen shadow (row * columns + column)
+  * @param const char *cells  New characters, NULL will write spaces
+  * @param int len            Number of characters
+  * @return                   Number of characters written
+  */
+#if (LCD_PLAN == 1)
+// The screen is split in segments of characters at consecutive memory addresses, see _planSegments(). Segments
+// that continue at the next memory address of another segment are written after that segment. A gap of unchanged
+// characters is rewritten from the shadow when this is cheaper than a set address. Only the chains of segments
+// that hold updated characters are visited.
+int TextLCD_Base::_writeCells(int pos, const char *cells, int len) {
+  int cnt = 0;       // Characters written
+  int gap;           // Unchanged characters since the last write, -1 when the memory address must be set
+  int gap_seg = 0, gap_off = 0;  // First unchanged character of the gap
+  int first, last;   // Updated characters of the segment
+  int seg, end, off, n, p;
+  char value;
+
+  // Cost model of the bus
+  int byte_us = _byte_us + _timing.normal;  // Command or data byte
+  int jump_us = byte_us;                   // Set address command
+#if (LCD_TX == 1)
+  int run_us = _runCost();
+  if (run_us > 0) {
+    // The bytes of a run are paced by the bus or by the execution time, a set address also ends the run
+    byte_us = (_byte_us > _timing.normal) ? _byte_us : _timing.normal;
+    jump_us = run_us + byte_us;
+  }
+
+  // Each run of characters is written with its set address command as a single transaction
+  _txBegin();
+#endif
+
+  for (int head=0; head<_nr_seg; head++) {
+    if (!_seg_head[head]) {
+      continue;
+    }
+
+    // Last segment of the chain with updated characters, skip the chain when there are none
+    end = -1;
+    for (seg=head; seg >= 0; seg = _seg_nxt[seg]) {
+      if ((_seg_pos[seg] < (pos + len)) && ((_seg_pos[seg] + _seg_len[seg]) > pos)) {
+        end = seg;
+      }
+    }
+    if (end < 0) {
+      continue;
+    }
+
+    gap = -1;
+    for (seg=head; ; seg = _seg_nxt[seg]) {
+      // Updated characters of the segment are at [first, last), none when first >= last
+      first = pos - _seg_pos[seg];
+      last = first + len;
+      if (first < 0) {
+        first = 0;
+      }
+      if (first > _seg_len[seg]) {
+        first = _seg_len[seg];
+      }
+      if (last > _seg_len[seg]) {
+        last = _seg_len[seg];
+      }
+
+      off = 0;
+      while (off < _seg_len[seg]) {
+        if ((off < first) || (off >= last)) {
+          // Characters are not updated, only used to fill a gap
+          n = (off < first) ? (first - off) : (_seg_len[seg] - off);
+        }
+        else {
+          p = _seg_pos[seg] + off;
+          value = (cells != NULL) ? cells[p - pos] : ' ';
+
+          if (!_shadow_ok || (_shadow[p] != value)) {
+            if (gap > 0) {
+              // Rewrite the unchanged characters, memory address continues
+              for (; gap > 0; gap--) {
+                _writeData(_shadow[_seg_pos[gap_seg] + gap_off]);
+                if (++gap_off == _seg_len[gap_seg]) {
+                  gap_seg = _seg_nxt[gap_seg];
+                  gap_off = 0;
+                }
+              }
+            }
+            else if (gap < 0) {
+              // Set the memory address, this will switch controllers for LCD40x4 when needed
+              _writeAddress(getAddress(p % _nr_cols, p / _nr_cols));
+            }
+
+            _writeData(value);
+            _shadow[p] = value;
+            cnt++;
+            gap = 0;
+            off++;
+            continue;
+          }
+          n = 1;
+        }
+
+        // Characters are unchanged, extend the gap while it is cheaper than a set address
+        if (gap >= 0) {
+          if (gap == 0) {
+            gap_seg = seg;
+            gap_off = off;
+          }
+          gap += n;
+
+          if (!_shadow_ok || ((gap * byte_us) >= jump_us)) {
+            gap = -1;
+          }
+        }
+        off += n;
+      }
+
+      if (seg == end) {
+        break;
+      }
+    }
+  }
+
+  if (cnt > 0) {
+    // Restore memory address, make sure cursor blinks at the correct location
+    _writeAddress(getAddress(_column, _row));
+  }
+
+#if (LCD_TX == 1)
+  _txEnd();
+#endif
+
+  return cnt;
+}
+
+/** Split the screen in segments of characters at consecutive memory addresses
+  *  The segments are linked in memory address order, LCD40x4 has one segment for each row.
+  *  @return none
+  */
+void TextLCD_Base::_planSegments() {
+  bool chain = (_addr_mode != LCD_T_E);  // getAddress() selects the controller for LCD40x4
+  int adr;
+
+  // Split the rows in segments
+  _nr_seg = 0;
+  for (int row=0; row<_nr_rows; row++) {
+    for (int col=0; col<_nr_cols; col++) {
+      adr = chain ? getAddress(col, row) : 0;
+
+      if ((col == 0) || (chain && (adr != (_seg_adr[_nr_seg - 1] + _seg_len[_nr_seg - 1])))) {
+        _seg_pos[_nr_seg] = (row * _nr_cols) + col;
+        _seg_len[_nr_seg] = 0;
+        _seg_adr[_nr_seg] = adr;
+        _seg_nxt[_nr_seg] = -1;
+        _seg_head[_nr_seg] = true;
+        _nr_seg++;
+      }
+      _seg_len[_nr_seg - 1]++;
+    }
+  }
+
+  // Link the segments in memory address order
+  for (int i=0; chain && (i<_nr_seg); i++) {
+    for (int j=0; j<_nr_seg; j++) {
+      if (_seg_adr[j] == (_seg_adr[i] + _seg_len[i])) {
+        _seg_nxt[i] = j;
+        _seg_head[j] = false;
+      }
+    }
+  }
+}
+#else
+int TextLCD_Base::_writeCells(int pos, const char *cells, int len) {
+  int cnt = 0;       // Characters written
+  int adr, next = -1;  // Memory address of the character, address after the previous character or -1
+  char value;
+
+#if (LCD_TX == 1)
+  // Each run of characters is written with its set address command as a single transaction
+  _txBegin();
+#endif
+
+  for (int i=0; i<len; i++, pos++) {
+    value = (cells != NULL) ? cells[i] : ' ';
+
+    if (_shadow_ok && (_shadow[pos] == value)) {
+      // Character is unchanged, skip
+      next = -1;
+    }
+    else {
+      // This will switch controllers for LCD40x4 when needed
+      adr = getAddress(pos % _nr_cols, pos / _nr_cols);
+
+      if (adr != next) {
+        // Set the memory address, the character does not continue from the previous one
+        // (eg next row, or the second half of a row for LCD_T_C and row 2 of LCD_T_F)
+        _writeAddress(adr);
+      }
+
+      _writeData(value);
+      _shadow[pos] = value;
+      next = adr + 1;
+      cnt++;
+    }
+  }
+
+  if (cnt > 0) {
+    // Restore memory address, make sure cursor blinks at the correct location
+    _writeAddress(getAddress(_column, _row));
+  }
+
+#if (LCD_TX == 1)
+  _txEnd();
+#endif
+
+  return cnt;
+}
+#endif
+
+/** Estimate the time to clear the screen by writing spaces using _writeCells()
+  *  @return time in us
+  */
+int TextLCD_Base::_fillCost() {
+  int ops = 1;       // Restore memory address
+  int adr, next = -1;  // Memory address of the character, address after the previous character or -1
+
+  for (int pos=0; pos < (_nr_cols * _nr_rows); pos++) {
+    if (_shadow[pos] != ' ') {
+      if (_addr_mode == LCD_T_E) {
+        // LCD40x4: getAddress() would switch controllers, rows are contiguous and never continue in the next row
+        adr = ((pos / _nr_cols) * 0x100) + (pos % _nr_cols);
+      }
+      else {
+        adr = getAddress(pos % _nr_cols, pos / _nr_cols);
+      }
+
+      if (adr != next) {
+        ops++;       // Set memory address
+      }
+      ops++;         // Write space
+      next = adr + 1;
+    }
+    else {
+      next = -1;
+    }
+  }
+
+  return ops * (_byte_us + _timing.normal);
+}
 #endif
-                   
-  setAddress(0, 0);  // Reset Cursor location
-                     // Note: This is needed because some displays (eg PCF21XX) don't use line 0 in the '3 Line' mode.   
+
+/** Estimate the time to clear the screen using the Clear Display instruction
+  *  @return time in us
+  */
+int TextLCD_Base::_clearCost() {
+
+  // Clear Display instruction
+  int cost = _byte_us + _timing.clear;
+
+  if (_addr_mode == LCD_T_E) {
+    // Clear on both controllers and restore the cursor modes
+    cost = (2 * cost) + (2 * (_byte_us + _timing.normal));  
+  }
+
+  return cost;
 }
 
 /** Locate cursor to a screen column and row
@@ -1557,19 +1970,19 @@ int TextLCD_Base::_putc(int value) {
       //Character to write
 
 #if (LCD_DEF_FONT == 1)   //Default HD44780 font
-      _writeData(value);
+      _writeChar(value);
 #elif (LCD_C_FONT == 1) || (LCD_R_FONT == 1) //PCF21xxC or PCF21xxR font
-      _writeData(ASCII_2_LCD(value));
+      _writeChar(ASCII_2_LCD(value));
 #elif (LCD_UTF8_FONT == 1) // UTF8 2 byte font (eg Cyrillic)
 //      value = UTF_2_LCD(value, utf_seq_rec_first_cyr, utf_seq_recode_cyr, &utf_rnd_recode_cyr[0][0]);      
       value = UTF_2_LCD(value);            
       if (value >= 0) {
-        _writeData(value);
+        _writeChar(value);
         
         // Only increment cursor when there is something to write
         //   Continue below to closing bracket...
 #else
-      _writeData('?'); //Oops, no font defined
+      _writeChar('?'); //Oops, no font defined
 #endif
 
       //Update Cursor
@@ -1597,12 +2010,23 @@ int TextLCD_Base::_putc(int value) {
 
     //Set next memoryaddress, make sure cursor blinks at next location
     addr = getAddress(_column, _row);
-    _writeCommand(0x80 | addr);
+    _writeAddress(addr);
             
     return value;
 }
 
 
+// Write a character at the current cursor location and update the screen shadow
+void TextLCD_Base::_writeChar(int value) {
+
+    _writeData(value);
+
+#if (LCD_SHADOW == 1)
+    _shadow[(_row * _nr_cols) + _column] = value;
+#endif
+}
+
+
 // get a single character (Stream implementation)
 int TextLCD_Base::_getc() {
     return -1;
@@ -1717,10 +2141,16 @@ int TextLCD_Base::putc(int c){
   */
 int TextLCD_Base::printf(const char* text, ...) {
   
+#if (LCD_TX == 1)
+  _txBegin();
+#endif
   while (*text !=0) {
     _putc(*text);
     text++;
   }
+#if (LCD_TX == 1)
+  _txEnd();
+#endif
   return 0;
 }
 #endif    
@@ -1729,13 +2159,11 @@ int TextLCD_Base::printf(const char* text, ...) {
 // Write a nibble using the 4-bit interface
 void TextLCD_Base::_writeNibble(int value) {
 
-// Enable is Low
-    this->_setEnable(true);        
-    this->_setData(value);        // Low nibble of value on D4..D7
-    wait_us(1); // Data setup time        
-    this->_setEnable(false);    
-    wait_us(1); // Datahold time
-// Enable is Low
+#if (LCD_TX == 1)
+    _txFlush();
+    _ac = -1;
+#endif
+    _writeOp(value, _LCDOp_Nibble);
 }
 
 // Write a byte using the 4-bit interface
@@ -1744,86 +2172,494 @@ void TextLCD_Base::_writeByte(int value) {
 // Enable is Low
     this->_setEnable(true);          
     this->_setData(value >> 4);   // High nibble
-    wait_us(1); // Data setup time    
+    _delay_ns(LCD_BUS_NS); // Data setup time    
     this->_setEnable(false);   
-    wait_us(1); // Data hold time
+    _delay_ns(LCD_BUS_NS); // Data hold time
     
     this->_setEnable(true);        
     this->_setData(value);        // Low nibble
-    wait_us(1); // Data setup time        
+    _delay_ns(LCD_BUS_NS); // Data setup time        
     this->_setEnable(false);    
-    wait_us(1); // Datahold time
+    _delay_ns(LCD_BUS_NS); // Datahold time
 
 // Enable is Low
 }
 
+// Readback is not supported by default
+int TextLCD_Base::_readByte() {
+    return -1;
+}
+
 // Write a command byte to the LCD controller
 void TextLCD_Base::_writeCommand(int command) {
 
-    this->_setRS(false);        
-    wait_us(1);  // Data setup time for RS       
-    
-    this->_writeByte(command);   
-    wait_us(40); // most instructions take 40us            
+  if ((command == 0x01) || (command == 0x02) || (command == 0x03)) {
+    // Clear Display or Return Home
+    _writeCommand(command, _LCDInstr_Clear);
+  }
+  else if ((command & 0xE0) == 0x20) {
+    // Function set
+    _writeCommand(command, _LCDInstr_Function);
+  }
+  else {
+    _writeCommand(command, _LCDInstr_Normal);
+  }
+}
+
+// Write a command byte to the LCD controller, the execution time is selected by the instruction class
+void TextLCD_Base::_writeCommand(int command, _LCDInstr instr) {
+
+#if (LCD_TX == 1)
+    // Collected operations go first, the command may change the address counter
+    _txFlush();
+    _ac = -1;
+#endif
+
+    if (instr == _LCDInstr_Function) {
+      _ext_set = _isExtendedSet(command);
+    }
+    else if (!_ext_set) {
+      // Data writes go to CGRAM after Set CGRAM address and to DDRAM after Set DDRAM address
+      if ((command & 0xC0) == 0x40) {
+        _cgram = true;
+      }
+      else if (command & 0x80) {
+        _cgram = false;
+      }
+    }
+
+    _writeOp(command, _LCDOp_Cmd);
+
+    switch (instr) {
+      case _LCDInstr_Clear:
+        _wait_us(_timing.clear);
+        break;
+      case _LCDInstr_Function:
+        _wait_us(_timing.function);
+        break;
+      default:
+        _wait_us(_timing.normal);
+        break;
+    }
+}
+
+// Test whether a Function set selects an extended instruction set of the controller
+// The instruction set bits are only tested for controllers that have instructions at 0x40-0x7F in that set
+bool TextLCD_Base::_isExtendedSet(int command) {
+
+    switch (_ctrl) {
+      case ST7032_3V3:
+      case ST7032_5V:
+      case SPLC792A_3V3:
+      case PCF2103_3V3:
+      case PCF2113_3V3:
+      case PCF2119_3V3:
+      case PCF2119R_3V3:
+        return (command & 0x01) != 0;   // IS or H
+
+      case ST7036_3V3:
+      case ST7036_5V:
+      case SSD1803_3V3:
+      case US2066_3V3:
+        return (command & 0x03) != 0;   // IS2, IS1 or RE, IS
+
+      case KS0073:
+      case KS0078:
+      case HD66712:
+      case ST7070:
+        return (command & 0x04) != 0;   // RE or EXT
+
+      default:
+        return false;                   // Bits select font, brightness etc
+    }
 }
 
 // Write a data byte to the LCD controller
 void TextLCD_Base::_writeData(int data) {
 
-    this->_setRS(true);            
-    wait_us(1);  // Data setup time for RS 
-        
-    this->_writeByte(data);
-    wait_us(40); // data writes take 40us                
+#if (LCD_TX == 1)
+    if (!_cgram) {
+      if ((_tx_level > 0) || (_tx_cmd >= 0)) {
+        // Collect the data byte with the deferred set address command
+        if (_tx_len == sizeof(_tx_data)) {
+          _txFlush();
+        }
+        _tx_data[_tx_len++] = data;
+        if (_ac >= 0) {
+          _ac++;              // DDRAM address increments after each write
+        }
+
+        if (_tx_level == 0) {
+          _txFlush();         // No transaction, write the command and data now
+        }
+        return;
+      }
+
+      if (_ac >= 0) {
+        _ac++;                // DDRAM address increments after each write
+      }
+    }
+#endif
+
+    _writeOp(data, _LCDOp_Data);
+    _wait_us(_cgram ? _timing.cgram : _timing.normal);
 }
 
+// Write an optional set address command and a run of data bytes to consecutive memory addresses
+// The default writes each byte as a separate operation
+void TextLCD_Base::_writeDataRun(int command, const char *data, int len) {
 
-// This replaces the original _address() method.
-// It is confusing since it returns the memoryaddress or-ed with the set memorycommand 0x80.
-// Left it in here for compatibility with older code. New applications should use getAddress() instead.
-int TextLCD_Base::_address(int column, int row) {
-  return 0x80 | getAddress(column, row);
+    if (command >= 0) {
+      _writeOp(command, _LCDOp_Cmd);
+      _wait_us(_timing.normal);
+    }
+
+    for (int i=0; i<len; i++) {
+      _writeOp(data[i], _LCDOp_Data);
+      _wait_us(_timing.normal);
+    }
 }
 
+#if (LCD_PLAN == 1)
+// Overhead of a data run on the bus, the default writes each byte as a separate operation
+int TextLCD_Base::_runCost() {
+    return 0;
+}
+#endif
 
-// This is new method to return the memory address based on row, column and displaytype.
-//
-/** Return the memoryaddress of screen column and row location
-   *
-   * @param column  The horizontal position from the left, indexed from 0
-   * @param row     The vertical position from the top, indexed from 0
-   * @return        The memoryaddress of screen column and row location
-   *
-   */
-int TextLCD_Base::getAddress(int column, int row) {
+// Set the DDRAM address
+// The command is skipped when the controller is already at the address, otherwise it is deferred
+// and merged with the data writes that follow
+void TextLCD_Base::_writeAddress(int addr) {
 
-    switch (_addr_mode) {
+#if (LCD_TX == 1)
+    if (_addr_mode == LCD_T_E) {
+      // Two controllers, getAddress() has already selected the controller for this address
+      _writeCommand(0x80 | addr);
+      return;
+    }
 
-        case LCD_T_A:
-          //Default addressing mode for 1, 2 and 4 rows (except 40x4)
-          //The two available rows are split and stacked on top of eachother. Addressing for 3rd and 4th line continues where lines 1 and 2 were split.          
-          //Displays top rows when less than four are used.          
-          switch (row) {
-            case 0:
-              return 0x00 + column;
-            case 1:
-              return 0x40 + column;
-            case 2:
-              return 0x00 + _nr_cols + column;
-            case 3:
-              return 0x40 + _nr_cols + column;
-            // Should never get here.
-//            default:            
-//              return 0x00;                    
-            }
-          
-        case LCD_T_B:
-          // LCD8x2B is a special layout of LCD16x1
-          if (row==0) 
-            return 0x00 + column;                        
-          else   
-//            return _nr_cols + column;                                    
-            return 0x08 + column;                        
+    if (_ac == addr) {
+      return;                 // Controller is at the address
+    }
+
+    if (_tx_len > 0) {
+      _txFlush();             // Write the current run before the jump
+    }
+
+    // Defer the command, this replaces a deferred command that was not followed by data
+    _tx_cmd = 0x80 | addr;
+    _ac = addr;
+    _cgram = false;
+
+    if ((_tx_level == 0) && (_currentCursor != CurOff_BlkOff)) {
+      _txFlush();             // The cursor shows the address
+    }
+#else
+    _writeCommand(0x80 | addr);
+#endif
+}
+
+#if (LCD_TX == 1)
+// Open a transaction, set address and data writes are collected until it is closed
+// The transaction is not used for LCD40x4, the address would have to select the controller
+void TextLCD_Base::_txBegin() {
+
+    if (_addr_mode != LCD_T_E) {
+      _tx_level++;
+    }
+}
+
+// Close a transaction and write the collected operations
+// A set address command without data is kept when the cursor is not visible
+void TextLCD_Base::_txEnd() {
+
+    if (_tx_level > 0) {
+      _tx_level--;
+
+      if ((_tx_level == 0) && ((_tx_len > 0) || (_currentCursor != CurOff_BlkOff))) {
+        _txFlush();
+      }
+    }
+}
+
+// Write the collected set address command and data bytes
+void TextLCD_Base::_txFlush() {
+    int command = _tx_cmd;
+    int len = _tx_len;
+
+    _tx_cmd = -1;
+    _tx_len = 0;
+
+    if (len > 0) {
+      _writeDataRun(command, _tx_data, len);
+    }
+    else if (command >= 0) {
+      _writeOp(command, _LCDOp_Cmd);
+      _wait_us(_timing.normal);
+    }
+}
+
+// Stream lock, a printf() is a single transaction
+void TextLCD_Base::lock() {
+    _txBegin();
+}
+
+// Stream unlock
+void TextLCD_Base::unlock() {
+    _txEnd();
+}
+#endif
+
+// Write a nibble, command or data byte to the LCD controller, or capture it for later
+void TextLCD_Base::_writeOp(int value, int flags) {
+
+  if (_ops != NULL) {
+    _queueOp(value, flags);
+    return;
+  }
+
+  _execOp(value, flags);
+}
+
+// Capture an operation, grow the buffer when it is full or write the oldest captured operation when it is at max size
+void TextLCD_Base::_queueOp(int value, int flags) {
+  _LCDOp *op;
+
+  if ((_ops_cnt >= _ops_max) && !_growOps()) {
+    _runOp();
+  }
+
+  if (_ctrl_idx == _LCDCtrl_1) {
+    flags |= _LCDOp_Ctrl1;  // Secondary controller (LCD40x4)
+  }
+
+  op = &_ops[(_ops_head + _ops_cnt) % _ops_max];
+  op->value = value;
+  op->flags = flags;
+  op->wait  = 0;
+  _ops_cnt++;
+}
+
+// Double the size of the captured operations buffer, the operations are moved to the start of the new buffer
+bool TextLCD_Base::_growOps() {
+  int max = 2 * _ops_max;
+  _LCDOp *ops;
+
+  if (max > LCD_STEP_MAX) {
+    return false;
+  }
+
+  ops = new _LCDOp[max];
+  for (int i=0; i<_ops_cnt; i++) {
+    ops[i] = _ops[(_ops_head + i) % _ops_max];
+  }
+
+  delete[] _ops;
+  _ops = ops;
+  _ops_head = 0;
+  _ops_max = max;
+
+  return true;
+}
+
+// Write a nibble, command or data byte to the LCD controller
+void TextLCD_Base::_execOp(int value, int flags) {
+
+    // Wait until the controller has completed the previous instruction
+    _waitBusy();
+
+    if (flags & _LCDOp_Wait) {
+      return;                       // No bus operation
+    }
+
+    _busLock();
+
+    if (flags & _LCDOp_Nibble) {
+      this->_setRS(false);          // command mode
+
+// Enable is Low
+      this->_setEnable(true);        
+      this->_setData(value);        // Low nibble of value on D4..D7
+      _delay_ns(LCD_BUS_NS); // Data setup time        
+      this->_setEnable(false);    
+      _delay_ns(LCD_BUS_NS); // Datahold time
+// Enable is Low
+    }
+    else {
+      this->_setRS((flags & _LCDOp_Data) != 0);
+      _delay_ns(LCD_BUS_NS);  // Data setup time for RS       
+
+      this->_writeByte(value);   
+    }
+
+    _busUnlock();
+}
+
+// Write all captured operations to the LCD controller
+void TextLCD_Base::_flushOps() {
+  while (_ops_cnt > 0) {
+    _runOp();
+  }
+}
+
+// Write the oldest captured operation to the LCD controller
+void TextLCD_Base::_runOp() {
+  _LCDOp *ops = _ops;
+  _LCDCtrl_Idx ctrl_idx = _ctrl_idx;
+ 
+  _ops = NULL;  // Write, dont capture
+  _replayOp(&ops[_ops_head]);
+  _ops = ops;
+
+  _ops_head = (_ops_head + 1) % _ops_max;
+  _ops_cnt--;
+
+  _ctrl_idx = ctrl_idx; // Restore controller select
+}
+
+// Write a captured operation to the LCD controller
+void TextLCD_Base::_replayOp(const _LCDOp *op) {
+
+  _ctrl_idx = (op->flags & _LCDOp_Ctrl1) ? _LCDCtrl_1 : _LCDCtrl_0;
+  _execOp(op->value, op->flags);
+  _wait_us(op->wait);
+}
+
+// Start the execution time of the last instruction, the next bus operation will wait until it has elapsed
+void TextLCD_Base::_wait_us(int us) {
+
+  if (_ops != NULL) {
+    // Add to execution time of last captured operation, use wait operations when there is none or it is at max
+    _LCDOp *op;
+    int add;
+
+    while (us > 0) {
+      op = &_ops[(_ops_head + _ops_cnt - 1 + _ops_max) % _ops_max];
+      if ((_ops_cnt == 0) || (op->wait == 0xFFFF)) {
+        _queueOp(0, _LCDOp_Wait);
+        op = &_ops[(_ops_head + _ops_cnt - 1) % _ops_max];
+      }
+
+      add = 0xFFFF - op->wait;
+      if (add > us) {
+        add = us;
+      }
+      op->wait += add;
+      us -= add;
+    }
+    return;
+  }
+
+  _startBusy(us);
+}
+
+// Start the execution time of the last instruction, also when operations are captured
+void TextLCD_Base::_startBusy(int us) {
+  uint32_t now, elapsed;
+
+  now = us_ticker_read();
+  elapsed = now - _busy_start;
+
+  // Any remaining time of the previous wait is added
+  if (elapsed < _busy_time) {
+    _busy_time = _busy_time - elapsed + us;
+  }
+  else {
+    _busy_time = us;
+  }
+  _busy_start = now;
+}
+
+void TextLCD_Base::_wait_ms(int ms) {
+  _wait_us(ms * 1000);
+}
+
+// Wait until the controller has completed the last instruction
+void TextLCD_Base::_waitBusy() {
+#if(LCD_SLEEP == 1)
+  // Long execution times sleep, the remaining time is a spin wait
+  _delay_us(_busyRemaining());
+#endif
+
+  while (_isBusy()) {
+  };
+}
+
+// Remaining execution time of the last instruction
+uint32_t TextLCD_Base::_busyRemaining() {
+  uint32_t elapsed;
+
+  if (!_isBusy()) {
+    return 0;
+  }
+
+  elapsed = us_ticker_read() - _busy_start;
+  return (elapsed < _busy_time) ? (_busy_time - elapsed) : 0;
+}
+
+// Test for completion of the last instruction
+bool TextLCD_Base::_isBusy() {
+
+  if (_busy_time == 0) {
+    return false;
+  }
+
+  if ((us_ticker_read() - _busy_start) < _busy_time) {
+    return true;
+  }
+
+  _busy_time = 0; // Done, also avoids false busy after timer wraps around
+  return false;
+}
+
+
+// This replaces the original _address() method.
+// It is confusing since it returns the memoryaddress or-ed with the set memorycommand 0x80.
+// Left it in here for compatibility with older code. New applications should use getAddress() instead.
+int TextLCD_Base::_address(int column, int row) {
+  return 0x80 | getAddress(column, row);
+}
+
+
+// This is new method to return the memory address based on row, column and displaytype.
+//
+/** Return the memoryaddress of screen column and row location
+   *
+   * @param column  The horizontal position from the left, indexed from 0
+   * @param row     The vertical position from the top, indexed from 0
+   * @return        The memoryaddress of screen column and row location
+   *
+   */
+int TextLCD_Base::getAddress(int column, int row) {
+
+    switch (_addr_mode) {
+
+        case LCD_T_A:
+          //Default addressing mode for 1, 2 and 4 rows (except 40x4)
+          //The two available rows are split and stacked on top of eachother. Addressing for 3rd and 4th line continues where lines 1 and 2 were split.          
+          //Displays top rows when less than four are used.          
+          switch (row) {
+            case 0:
+              return 0x00 + column;
+            case 1:
+              return 0x40 + column;
+            case 2:
+              return 0x00 + _nr_cols + column;
+            case 3:
+              return 0x40 + _nr_cols + column;
+            // Should never get here.
+//            default:            
+//              return 0x00;                    
+            }
+          
+        case LCD_T_B:
+          // LCD8x2B is a special layout of LCD16x1
+          if (row==0) 
+            return 0x00 + column;                        
+          else   
+//            return _nr_cols + column;                                    
+            return 0x08 + column;                        
 
         case LCD_T_C:
           // LCD16x1C is a special layout of LCD8x2
@@ -1980,7 +2816,7 @@ void TextLCD_Base::setAddress(int column, int row) {
 //               switch cursor if needed
     int addr = getAddress(_column, _row);
     
-    _writeCommand(0x80 | addr);
+    _writeAddress(addr);
 }
 
 
@@ -2095,6 +2931,8 @@ void TextLCD_Base::_setCursorAndDisplayMode(LCDMode displayMode, LCDCursor curso
   */
 void TextLCD_Base::setBacklight(LCDBacklight backlightMode) {
 
+    _busLock();
+
 #if (BACKLIGHT_INV==0)      
     // Positive Backlight control pin logic
     if (backlightMode == LightOn) {
@@ -2112,6 +2950,8 @@ void TextLCD_Base::setBacklight(LCDBacklight backlightMode) {
       this->_setBL(true);           
     }
 #endif    
+
+    _busUnlock();
 } 
 
 /** Set User Defined Characters
@@ -2187,7 +3027,7 @@ void TextLCD_Base::_setUDC(unsigned char c, char *udc_data) {
    
   //Select DD RAM again for current LCD controller and restore the addresspointer
   int addr = getAddress(_column, _row);
-  _writeCommand(0x80 | addr);  
+  _writeAddress(addr);  
 }
 
 #if(LCD_BLINK == 1)
@@ -2405,7 +3245,7 @@ void TextLCD_Base::setPower(bool powerOn) {
 
       case WS0010:      
         _writeCommand(0x17);   // Char mode, DC/DC on        
-        wait_ms(10);           // Wait 10ms to ensure powered up             
+        _wait_us(_timing.extended); // Wait to ensure powered up             
         break;
 
       case KS0073:        
@@ -2503,7 +3343,7 @@ void TextLCD_Base::setOrient(LCDOrient orient){
           _writeCommand(0x40 | 0x00);               // COM/SEG directions 0 1 0 0 C1, C2, S1, S2  (Instr Set 1)
                                                     // C1=1: Com1-8 -> Com8-1;   C2=1: Com9-16 -> Com16-9
                                                     // S1=1: Seg1-40 -> Seg40-1; S2=1: Seg41-80 -> Seg80-41                                                    
-          wait_ms(5);                               // Wait to ensure completion or ST7070 fails to set Top/Bottom after reset..
+          _wait_us(_timing.extended);                // Wait to ensure completion or ST7070 fails to set Top/Bottom after reset..
           
           _writeCommand(0x20 | _function);          // Set function, EXT=0 (Select Instr Set = 0)
         
@@ -2556,7 +3396,7 @@ void TextLCD_Base::setOrient(LCDOrient orient){
           _writeCommand(0x40 | 0x0F);               // COM/SEG directions 0 1 0 0 C1, C2, S1, S2  (Instr Set 1)
                                                     // C1=1: Com1-8 -> Com8-1;   C2=1: Com9-16 -> Com16-9
                                                     // S1=1: Seg1-40 -> Seg40-1; S2=1: Seg41-80 -> Seg80-41                                                    
-          wait_ms(5);                               // Wait to ensure completion or ST7070 fails to set Top/Bottom after reset..
+          _wait_us(_timing.extended);                // Wait to ensure completion or ST7070 fails to set Top/Bottom after reset..
           
           _writeCommand(0x20 | _function);          // Set function, EXT=0 (Select Instr Set = 0)
         
@@ -2783,7 +3623,7 @@ void TextLCD_Base::setFont(LCDFont font) {
   //SSD1803 seems to screw up cursor position after selecting new font. Restore to make sure...
   //Set next memoryaddress, make sure cursor blinks at next location
   int addr = getAddress(_column, _row);
-  _writeCommand(0x80 | addr);
+  _writeAddress(addr);
          
 }
 #endif
@@ -3083,90 +3923,766 @@ void TextLCD_Base::setInvert(bool invertOn) {
 } // end setInvert()
 #endif
 
-//--------- End TextLCD_Base -----------
-
+#if(LCD_GROUP == 1)
+// Init in constructor is skipped when set, see deferInit()
+bool TextLCD_Base::_init_defer = false;
 
-//--------- Start TextLCD Bus -----------
+/** Defer the initialisation of all displays that are constructed after this call
+  * Deferred displays must be initialised by initGroup() before they can be used.
+  *
+  * @param bool defer  Defer init (true) or init in the constructor (false, default)
+  * @return none
+  */
+void TextLCD_Base::deferInit(bool defer) {
+  _init_defer = defer;
+}
 
-/* Create a TextLCD interface for using regular mbed pins
- *
- * @param rs     Instruction/data control line
- * @param e      Enable line (clock)
- * @param d4-d7  Data lines for using as a 4-bit interface
- * @param type   Sets the panel size/addressing mode (default = LCD16x2)
- * @param bl     Backlight control line (optional, default = NC)  
- * @param e2     Enable2 line (clock for second controller, LCD40x4 only) 
- * @param ctrl   LCD controller (default = HD44780)   
- */ 
-TextLCD::TextLCD(PinName rs, PinName e,
-                 PinName d4, PinName d5, PinName d6, PinName d7,
-                 LCDType type, PinName bl, PinName e2, LCDCtrl ctrl) :
-                 TextLCD_Base(type, ctrl), 
-                 _rs(rs), _e(e), _d(d4, d5, d6, d7) {
+/** Initialise a group of displays that were constructed with deferInit() enabled
+  * The init sequences of all displays are interleaved: instructions are written to one display
+  * while the others are still executing. The total init time is close to that of a single display.
+  *
+  * @param TextLCD_Base *lcd[]  Array of pointers to the displays
+  * @param int nr_lcd           Number of displays in the array
+  * @return none
+  */
+void TextLCD_Base::initGroup(TextLCD_Base *lcd[], int nr_lcd) {
+  TextLCD_Base *p;
+  bool *own = new bool[nr_lcd];  // Capture buffer allocated here, displays in step mode use their own queue
+
+  _delay_us(100000);             // Wait 100ms to ensure all displays are powered up
+
+  // Capture the init sequence for each display
+  for (int i=0; i<nr_lcd; i++) {
+    p = lcd[i];
+    own[i] = (p->_ops == NULL);
+    if (own[i]) {
+      p->_ops = new _LCDOp[LCD_INIT_OPS];
+      p->_ops_max = LCD_INIT_OPS;
+      p->_ops_head = 0;
+      p->_ops_cnt = 0;
+    }
+    p->_initDisplay();
+  }
 
-  // The hardware Backlight pin is optional. Test and make sure whether it exists or not to prevent illegal access.
-  if (bl != NC) {
-    _bl = new DigitalOut(bl);   //Construct new pin 
-    _bl->write(0);              //Deactivate    
+  // Write the captured operations interleaved
+  flushGroup(lcd, nr_lcd);
+
+  // Release the capture buffers
+  for (int i=0; i<nr_lcd; i++) {
+    p = lcd[i];
+    if (own[i]) {
+      delete[] p->_ops;
+      p->_ops = NULL;
+      p->_ops_head = 0;
+      p->_ops_cnt = 0;
+      p->_ops_max = 0;
+    }
   }
-  else {
-    // No Hardware Backlight pin       
-    _bl = NULL;                 //Construct dummy pin     
-  }  
+  delete[] own;
+}
 
-  // The hardware Enable2 pin is only needed for LCD40x4. Test and make sure whether it exists or not to prevent illegal access.
-  if (e2 != NC) {
-    _e2 = new DigitalOut(e2);   //Construct new pin 
-    _e2->write(0);              //Deactivate    
+/** Write queued bus operations for a group of displays in step mode, returns without waiting
+  * Each display that has completed its last instruction writes one operation, so the bus is used
+  * for the other displays while a display is still executing.
+  *
+  * @param TextLCD_Base *lcd[]  Array of pointers to the displays
+  * @param int nr_lcd           Number of displays in the array
+  * @return Number of pending bus operations for all displays
+  */
+int TextLCD_Base::stepGroup(TextLCD_Base *lcd[], int nr_lcd) {
+  TextLCD_Base *p;
+  int pending = 0;
+
+  for (int i=0; i<nr_lcd; i++) {
+    p = lcd[i];
+    if ((p->_ops_cnt > 0) && !p->_isBusy()) {
+      p->_runOp();
+    }
+    pending += p->_ops_cnt;
   }
-  else {
-    // No Hardware Enable pin       
-    _e2 = NULL;                 //Construct dummy pin     
-  }  
-  
-   _init(_LCD_DL_4);   // Set Datalength to 4 bit for mbed bus interfaces
+
+  return pending;
 }
 
-/** Destruct a TextLCD interface for using regular mbed pins
+/** Write all queued bus operations for a group of displays in step mode
+  * The operations are interleaved as in stepGroup(). Waits when all displays are still executing.
   *
-  * @param  none
+  * @param TextLCD_Base *lcd[]  Array of pointers to the displays
+  * @param int nr_lcd           Number of displays in the array
   * @return none
-  */ 
-TextLCD::~TextLCD() {
-   if (_bl != NULL) {delete _bl;}  // BL pin
-   if (_e2 != NULL) {delete _e2;}  // E2 pin
+  */
+void TextLCD_Base::flushGroup(TextLCD_Base *lcd[], int nr_lcd) {
+  TextLCD_Base *p;
+  bool busy, written;
+  uint32_t remaining, shortest;
+
+  // Displays that are still executing their last instruction are skipped,
+  // so the bus is used for the other displays in the meantime.
+  do {
+    busy = false;
+    written = false;
+    shortest = 0xFFFFFFFF;
+    for (int i=0; i<nr_lcd; i++) {
+      p = lcd[i];
+      if (p->_ops_cnt > 0) {
+        busy = true;
+        remaining = p->_busyRemaining();
+        if (remaining == 0) {
+          p->_runOp();
+          written = true;
+        }
+        else if (remaining < shortest) {
+          shortest = remaining;
+        }
+      }
+    }
+
+    // All displays are executing, wait for the first one to complete
+    if (busy && !written) {
+      _delay_us(shortest);
+    }
+  } while (busy);
 }
+#endif
 
-/** Set E pin (or E2 pin)
-  * Used for mbed pins, I2C bus expander or SPI shiftregister
-  * Default PinName value for E2 is NC, must be used as pointer to avoid issues with mbed lib and DigitalOut pins
-  *   @param  value true or false
-  *   @return none 
+// Instruction execution times in us, from the controller datasheets with some margin
+// Controllers without a busy flag readout are not polled, the waits must cover the worst case oscillator frequency
+//                                                                 normal, clear, function, extended, cgram
+static const TextLCD_Base::LCDTiming _timing_HD44780  = {    40, 20000,    40,    10000,    40};  // Default, also used for unknown clones
+static const TextLCD_Base::LCDTiming _timing_KS0073   = {    40,  3000,    40,    10000,    40};  // 39us, Clear 1.53ms
+static const TextLCD_Base::LCDTiming _timing_ST7032   = {    30,  2000,    30,    10000,    30};  // 26.3us, Clear 1.08ms
+static const TextLCD_Base::LCDTiming _timing_SSD1803  = {    40,  3000,    40,    10000,    40};  // 39us, Clear 1.53ms
+static const TextLCD_Base::LCDTiming _timing_WS0010   = {    40, 10000,    40,    10000,    40};  // Clear 6.2ms
+static const TextLCD_Base::LCDTiming _timing_PT6314   = {    40,  3000,    40,    10000,    40};  // Clear 2.25ms
+
+/** Set the instruction execution times
+  * The default table is selected by the controller type. Calibrated units may use shorter times.
+  * Use deferInit() and initGroup() when the new times should also be used for the init sequence.
+  *
+  * @param const LCDTiming *timing  Execution times in us, NULL restores the defaults for the controller (default)
+  * @return none
   */
-void TextLCD::_setEnable(bool value) {
+void TextLCD_Base::setTiming(const LCDTiming *timing) {
 
-  if(_ctrl_idx==_LCDCtrl_0) {
-    if (value) {
-      _e  = 1;    // Set E bit 
-    }  
-    else { 
-      _e  = 0;    // Reset E bit  
-    }  
-  }    
-  else { 
-    if (value) {
-      if (_e2 != NULL) {_e2->write(1);}  //Set E2 bit
-    }  
-    else { 
-      if (_e2 != NULL) {_e2->write(0);}  //Reset E2 bit     
-    }  
-  }    
-}    
+  if (timing != NULL) {
+    _timing = *timing;
+    return;
+  }
 
-// Set RS pin
+  switch (_ctrl) {
+    case KS0073:
+    case KS0078:
+      _timing = _timing_KS0073;
+      break;
+
+    case ST7032_3V3:
+    case ST7032_5V:
+    case ST7036_3V3:
+    case ST7036_5V:
+    case SPLC792A_3V3:
+      _timing = _timing_ST7032;
+      break;
+
+    case SSD1803_3V3:
+      _timing = _timing_SSD1803;
+      break;
+
+    case WS0010:
+      _timing = _timing_WS0010;
+      break;
+
+    case PT6314:
+      _timing = _timing_PT6314;
+      break;
+
+    default:
+      _timing = _timing_HD44780;
+      break;
+  }
+}
+
+/** Get the instruction execution times
+  *
+  * @param LCDTiming *timing  Returns the execution times in us
+  * @return none
+  */
+void TextLCD_Base::getTiming(LCDTiming *timing) {
+  *timing = _timing;
+}
+
+#if(LCD_CALIBRATE == 1)
+/** Measure the instruction execution times of the attached display and store them in the timing table
+  * The busy flag is polled after Set DDRAM address, Return Home, Function set and a CGRAM data write.
+  * The extended instruction time is not measured. Needs a bus that supports readback
+  * (mbed pins with RW pin, native I2C or native SPI3 with MISO for controllers that support reading).
+  *
+  * @param int margin  Safety margin in percent added to the measured times (default = 25)
+  * @return true when calibrated, false when readback is not supported or the controller did not respond
+  */
+bool TextLCD_Base::calibrate(int margin) {
+  LCDTiming timing = _timing;
+  int t[5], value;
+  bool ok;
+
+  // Complete the queued operations and the last instruction, then test readback support
+  _flushOps();
+#if (LCD_TX == 1)
+  _txFlush();
+#endif
+  _waitBusy();
+
+  // The bus is held during calibration
+  _busLock();
+#if(LCD_BUSLOCK == 1)
+  _hold = true;
+#endif
+
+  _setRS(false);
+  wait_us(1);
+  if (_readByte() < 0) {
+#if(LCD_BUSLOCK == 1)
+    _hold = false;
+#endif
+    _busUnlock();
+    return false;
+  }
+
+  // Most instructions: Set DDRAM address
+  t[0] = _measureOp(0x80, _LCDOp_Cmd, _timing.normal);
+
+  // DDRAM data write: read the character at address 0 and write it back 
+  _setRS(true);
+  wait_us(1);
+  value = _readByte();
+  wait_us(_timing.normal);  // Address counter update after read
+  _measureOp(0x80, _LCDOp_Cmd, _timing.normal);
+  t[1] = _measureOp(value, _LCDOp_Data, _timing.normal);
+
+  // Return Home, Clear Display is assumed to take the same time
+  // The controller must be busy at the first poll, otherwise the readback does not work (eg MISO not connected)
+  t[2] = _measureOp(0x02, _LCDOp_Cmd, -1);
+
+  // Function set, Instruction Set 0
+  t[3] = _measureOp(0x20 | _function, _LCDOp_Cmd, _timing.function);
+
+  // CGRAM data write: read the first row of UDC 7 and write it back
+  _measureOp(0x40 | 0x38, _LCDOp_Cmd, _timing.normal);
+  _setRS(true);
+  wait_us(1);
+  value = _readByte();
+  wait_us(_timing.normal);  // Address counter update after read
+  _measureOp(0x40 | 0x38, _LCDOp_Cmd, _timing.normal);
+  t[4] = _measureOp(value, _LCDOp_Data, _timing.cgram);
+
+  ok = (t[0] >= 0) && (t[1] >= 0) && (t[2] >= 0) && (t[3] >= 0) && (t[4] >= 0);
+  if (ok) {
+    // Add the safety margin
+    for (int i=0; i<5; i++) {
+      t[i] = t[i] + ((t[i] * margin) / 100);
+    }
+    timing.normal   = (t[0] > t[1]) ? t[0] : t[1];
+    timing.clear    = t[2];
+    timing.function = t[3];
+    timing.cgram    = t[4];
+    setTiming(&timing);
+  }
+
+#if(LCD_BUSLOCK == 1)
+  _hold = false;
+#endif
+  _busUnlock();
+
+#if (LCD_TX == 1)
+  // The instructions were written around _writeCommand(), the address counter is unknown
+  _ac = -1;
+#endif
+
+  // Restore the memory address
+  setAddress(_column, _row);
+
+  return ok;
+}
+
+/** Measure the execution time of an instruction by polling the busy flag
+  *  @param int value    Command or data byte
+  *  @param int flags    Operation type (_LCDOpFlags)
+  *  @param int current  Current execution time, used when the time is below the resolution of the readback,
+  *                      -1 when the instruction must be seen busy to verify the readback
+  *  @return time in us, -1 when the controller did not respond
+  */
+int TextLCD_Base::_measureOp(int value, int flags, int current) {
+  uint32_t start, time;
+  int status, polls = 0;
+
+  // Write the instruction, the controller is not busy
+  _execOp(value, flags);
+  start = us_ticker_read();
+
+  // Poll the busy flag, timeout after 100ms
+  _setRS(false);
+  do {
+    wait_us(1);
+    status = _readByte();
+    polls++;
+    time = us_ticker_read() - start;
+    if ((status < 0) || (time > 100000)) {
+      return -1;
+    }
+  } while (status & 0x80);
+
+  // The instruction completed before the first poll, the execution time is not resolved and the current
+  // time is kept. A shorter time could be a readback that never reports busy.
+  if (polls == 1) {
+    return current;
+  }
+
+  return time;
+}
+#endif
+
+#if(LCD_SLEEP == 1)
+// Minimum delay in us that will sleep, see setSleep()
+int TextLCD_Base::_sleep_threshold = LCD_SLEEP_US;
+
+/** Set the threshold for delays that sleep instead of spin wait
+  * Applies to all displays. Shorter delays remain spin waits.
+  *
+  * @param int threshold  Minimum delay in us that will sleep, 0 disables sleep (default = LCD_SLEEP_US)
+  * @return none
+  */
+void TextLCD_Base::setSleep(int threshold) {
+  _sleep_threshold = threshold;
+}
+
+#if !MBED_CONF_RTOS_PRESENT
+// Set by the Timeout that ends a sleep
+static volatile bool _sleep_done;
+
+static void _sleep_wakeup() {
+  _sleep_done = true;
+}
+#endif
+#endif
+
+// Blocking delay, long delays sleep instead of spin wait
+void TextLCD_Base::_delay_us(uint32_t us) {
+
+#if(LCD_SLEEP == 1)
+  if ((_sleep_threshold > 0) && (us >= (uint32_t) _sleep_threshold)) {
+#if MBED_CONF_RTOS_PRESENT
+    // Other threads run while this one sleeps, the sub-ms remainder is a spin wait
+    ThisThread::sleep_for(us / 1000);
+    us = us % 1000;
+#else
+    // Sleep until the Timeout expires, other interrupts may wake up the core earlier
+    Timeout timeout;
+
+    _sleep_done = false;
+    timeout.attach_us(&_sleep_wakeup, us);
+    while (!_sleep_done) {
+      sleep();
+    }
+    return;
+#endif
+  }
+#endif
+
+  wait_us(us);
+}
+
+// Short delay for the parallel bus setup and hold times
+// The loop takes at least 4 cycles, so the delay is at least ns
+void TextLCD_Base::_delay_ns(int ns) {
+  volatile uint32_t loops = (((SystemCoreClock / 1000000) * ns) + 3999) / 4000;
+
+  while (loops > 0) {
+    loops--;
+  }
+}
+
+// Acquire the bus for a bus operation, unless it is held for a chunk of operations
+void TextLCD_Base::_busLock() {
+#if(LCD_BUSLOCK == 1)
+  if ((_lock != NULL) && !_hold) {
+    _lock();
+  }
+#endif
+}
+
+// Release the bus after a bus operation, unless it is held for a chunk of operations
+void TextLCD_Base::_busUnlock() {
+#if(LCD_BUSLOCK == 1)
+  if ((_unlock != NULL) && !_hold) {
+    _unlock();
+  }
+#endif
+}
+
+#if(LCD_BUSLOCK == 1)
+/** Set hooks to share the bus with other devices, eg an RTOS Mutex or I2C::lock() and I2C::unlock()
+  * The bus is locked for each bus operation. update() keeps the bus locked for a chunk of operations
+  * and yields after the max hold time. Otherwise the bus is not locked while waiting for the controller.
+  *
+  * @param lock    Function to acquire the bus, NULL disables locking (default)
+  * @param unlock  Function to release the bus
+  * @param hold    Max time in us that update() holds the bus (default = LCD_BUS_HOLD)
+  * @return none
+  */
+void TextLCD_Base::setBusLock(void (*lock)(void), void (*unlock)(void), int hold) {
+  _lock = lock;
+  _unlock = unlock;
+  _hold_max = hold;
+}
+#endif
+
+#if(LCD_STEP == 1)
+/** Enable or disable step mode
+  * In step mode all bus operations are queued and written by step(), methods return without waiting for the bus.
+  * Pending operations are written when step mode is disabled.
+  *
+  * @param bool step  Step mode on (true, default) or off
+  * @return none
+  */
+void TextLCD_Base::setStepMode(bool step) {
+
+  if (step && (_ops == NULL)) {
+    // Size for a full redraw: all characters, a set address for each row and the cursor restore
+    _ops_max = (_nr_cols * _nr_rows) + (2 * _nr_rows) + 16;
+    if (_ops_max < LCD_STEP_OPS) {
+      _ops_max = LCD_STEP_OPS;
+    }
+    _ops = new _LCDOp[_ops_max];
+    _ops_head = 0;
+    _ops_cnt = 0;
+  }
+  else if (!step && (_ops != NULL)) {
+    _flushOps();
+    delete[] _ops;
+    _ops = NULL;
+    _ops_head = 0;
+    _ops_max = 0;
+  }
+}
+
+/** Write at most one queued bus operation, returns immediately when the controller is still busy
+  * Call from the superloop in step mode.
+  *
+  * @param  none
+  * @return Number of pending bus operations
+  */
+int TextLCD_Base::step() {
+
+  if ((_ops_cnt > 0) && !_isBusy()) {
+    _runOp();
+  }
+
+  return _ops_cnt;
+}
+
+/** Set the time budget for update()
+  * A budget enables step mode, 0 disables step mode and writes the pending operations.
+  *
+  * @param int budget  Max time in us spent in update(), 0 disables step mode
+  * @return none
+  */
+void TextLCD_Base::setBudget(int budget) {
+  _budget = budget;
+  setStepMode(budget > 0);
+}
+
+/** Write queued bus operations until the time budget is used up, waits for the controller within the budget
+  * At least one operation is written when the controller is ready. Call periodically, eg between watchdog kicks.
+  *
+  * @param  none
+  * @return Number of pending bus operations, 0 when all updates are complete
+  */
+int TextLCD_Base::update() {
+  uint32_t start = us_ticker_read();
+  uint32_t next;
+
+  // Make progress even when the budget is smaller than a single operation
+  if ((_ops_cnt > 0) && !_isBusy()) {
+    _runOp();
+  }
+
+  // Continue while the wait for the controller and the next operation fit in the budget
+  while (_ops_cnt > 0) {
+    next = _busyRemaining() + _byte_us;
+    if (((us_ticker_read() - start) + next) > (uint32_t) _budget) {
+      break;
+    }
+
+#if(LCD_BUSLOCK == 1)
+    // Hold the bus for a chunk of operations, yield to other devices after the max hold time
+    if (_hold && (((us_ticker_read() - _hold_start) + next) > (uint32_t) _hold_max)) {
+      _hold = false;
+      _busUnlock();
+    }
+    if (!_hold) {
+      // Wait for the controller before the bus is taken, the wait is not part of the hold time
+      _waitBusy();
+      _busLock();
+      _hold = true;
+      _hold_start = us_ticker_read();
+    }
+#endif
+
+    _runOp();
+  }
+
+#if(LCD_BUSLOCK == 1)
+  if (_hold) {
+    _hold = false;
+    _busUnlock();
+  }
+#endif
+
+  return _ops_cnt;
+}
+#endif
+
+//--------- End TextLCD_Base -----------
+
+
+//--------- Start TextLCD Bus -----------
+
+/* Create a TextLCD interface for using regular mbed pins
+ *
+ * @param rs     Instruction/data control line
+ * @param e      Enable line (clock)
+ * @param d4-d7  Data lines for using as a 4-bit interface
+ * @param type   Sets the panel size/addressing mode (default = LCD16x2)
+ * @param bl     Backlight control line (optional, default = NC)  
+ * @param e2     Enable2 line (clock for second controller, LCD40x4 only) 
+ * @param ctrl   LCD controller (default = HD44780)   
+ */ 
+TextLCD::TextLCD(PinName rs, PinName e,
+                 PinName d4, PinName d5, PinName d6, PinName d7,
+                 LCDType type, PinName bl, PinName e2, LCDCtrl ctrl, PinName rw) :
+                 TextLCD_Base(type, ctrl), 
+                 _rs(rs), _e(e), _d(d4, d5, d6, d7) {
+
+  // The databus is only switched to input for readback
+  _d.output();
+
+#if DEVICE_PORTOUT
+  _port = NULL;
+#endif
+
+  _initPins(bl, e2, rw);
+  
+  _byte_us = 6;       // Bus timing estimate: RS and two Enable strobes with 1us setup/hold
+
+   _init(_LCD_DL_4);   // Set Datalength to 4 bit for mbed bus interfaces
+}
+
+#if (LCD_BUS8 == 1)
+/* Create a TextLCD interface for using regular mbed pins with an 8 bit databus
+ *
+ * @param rs     Instruction/data control line
+ * @param e      Enable line (clock)
+ * @param d0-d7  Data lines for using as an 8-bit interface
+ * @param type   Sets the panel size/addressing mode (default = LCD16x2)
+ * @param bl     Backlight control line (optional, default = NC)  
+ * @param e2     Enable2 line (clock for second controller, LCD40x4 only) 
+ * @param ctrl   LCD controller (default = HD44780)   
+ * @param rw     Read/write line (optional, default = NC, RW must be tied to GND)  
+ */ 
+TextLCD::TextLCD(PinName rs, PinName e,
+                 PinName d0, PinName d1, PinName d2, PinName d3,
+                 PinName d4, PinName d5, PinName d6, PinName d7,
+                 LCDType type, PinName bl, PinName e2, LCDCtrl ctrl, PinName rw) :
+                 TextLCD_Base(type, ctrl), 
+                 _rs(rs), _e(e), _d(d0, d1, d2, d3, d4, d5, d6, d7) {
+
+  // The databus is only switched to input for readback
+  _d.output();
+
+#if DEVICE_PORTOUT
+  _port = NULL;
+#endif
+
+  _initPins(bl, e2, rw);
+
+  _bus_dl = _LCD_DL_8;  // 8 bit databus to the controller
+  
+  _byte_us = 3;       // Bus timing estimate: RS and one Enable strobe with 1us setup/hold
+
+  _init(_LCD_DL_8);   // Set Datalength to 8 bit for mbed bus interfaces
+}
+
+#if DEVICE_PORTOUT
+/* Create a TextLCD interface for using regular mbed pins with an 8 bit databus on contiguous pins of a port
+ *
+ * @param rs     Instruction/data control line
+ * @param e      Enable line (clock)
+ * @param port   Port for the data lines
+ * @param d0     Bit number of data line D0 in the port, D1..D7 use the next bits
+ * @param type   Sets the panel size/addressing mode (default = LCD16x2)
+ * @param bl     Backlight control line (optional, default = NC)  
+ * @param e2     Enable2 line (clock for second controller, LCD40x4 only) 
+ * @param ctrl   LCD controller (default = HD44780)   
+ */ 
+TextLCD::TextLCD(PinName rs, PinName e, PortName port, int d0,
+                 LCDType type, PinName bl, PinName e2, LCDCtrl ctrl) :
+                 TextLCD_Base(type, ctrl), 
+                 _rs(rs), _e(e), _d(NC) {
+
+  // The databus is written by PortOut, no readback
+  _port = new PortOut(port, 0xFF << d0);
+  _port_shift = d0;
+  _port_rs = 0;   // RS and E use DigitalOut
+  _port_e = 0;
+  _port_bus = 0;
+
+  _initPins(bl, e2, NC);
+
+  _bus_dl = _LCD_DL_8;  // 8 bit databus to the controller
+  
+  _byte_us = 2;       // Bus timing estimate: RS and one Enable strobe with 1us setup/hold, single port write
+
+  _init(_LCD_DL_8);   // Set Datalength to 8 bit for mbed bus interfaces
+}
+#endif
+#endif
+
+#if (LCD_PORT == 1) && DEVICE_PORTOUT
+/* Create a TextLCD interface for using regular mbed pins with the databus, RS and E on one port
+ *
+ * @param port   Port for the data and control lines
+ * @param rs     Bit number of RS in the port
+ * @param e      Bit number of E in the port
+ * @param d4     Bit number of data line D4 in the port, D5..D7 use the next bits
+ * @param type   Sets the panel size/addressing mode (default = LCD16x2)
+ * @param bl     Backlight control line (optional, default = NC)  
+ * @param e2     Enable2 line (clock for second controller, LCD40x4 only) 
+ * @param ctrl   LCD controller (default = HD44780)   
+ */ 
+TextLCD::TextLCD(PortName port, int rs, int e, int d4,
+                 LCDType type, PinName bl, PinName e2, LCDCtrl ctrl) :
+                 TextLCD_Base(type, ctrl), 
+                 _rs(NC), _e(NC), _d(NC) {
+
+  // The databus, RS and E are written by PortOut, no readback
+  _port = new PortOut(port, (0x0F << d4) | (1 << rs) | (1 << e));
+  _port_shift = d4;
+  _port_rs = (1 << rs);
+  _port_e = (1 << e);
+  _port_bus = 0;
+  _port->write(_port_bus);
+
+  _initPins(bl, e2, NC);
+  
+  _byte_us = 2;       // Bus timing estimate: RS and two Enable strobes with short setup/hold
+
+  _init(_LCD_DL_4);   // Set Datalength to 4 bit for mbed bus interfaces
+}
+#endif
+
+// Init the optional Hardware pins
+void TextLCD::_initPins(PinName bl, PinName e2, PinName rw) {
+
+  // The hardware Backlight pin is optional. Test and make sure whether it exists or not to prevent illegal access.
+  if (bl != NC) {
+    _bl = new DigitalOut(bl);   //Construct new pin 
+    _bl->write(0);              //Deactivate    
+  }
+  else {
+    // No Hardware Backlight pin       
+    _bl = NULL;                 //Construct dummy pin     
+  }  
+
+  // The hardware Enable2 pin is only needed for LCD40x4. Test and make sure whether it exists or not to prevent illegal access.
+  if (e2 != NC) {
+    _e2 = new DigitalOut(e2);   //Construct new pin 
+    _e2->write(0);              //Deactivate    
+  }
+  else {
+    // No Hardware Enable pin       
+    _e2 = NULL;                 //Construct dummy pin     
+  }  
+
+  // The hardware RW pin is only needed for readback. Test and make sure whether it exists or not to prevent illegal access.
+  if (rw != NC) {
+    _rw = new DigitalOut(rw);   //Construct new pin 
+    _rw->write(0);              //Write    
+  }
+  else {
+    // No Hardware RW pin, RW must be tied to GND       
+    _rw = NULL;                 //Construct dummy pin     
+  }  
+}
+
+/** Destruct a TextLCD interface for using regular mbed pins
+  *
+  * @param  none
+  * @return none
+  */ 
+TextLCD::~TextLCD() {
+   if (_bl != NULL) {delete _bl;}  // BL pin
+   if (_e2 != NULL) {delete _e2;}  // E2 pin
+   if (_rw != NULL) {delete _rw;}  // RW pin
+#if DEVICE_PORTOUT
+   if (_port != NULL) {delete _port;}  // Databus port
+#endif
+}
+
+/** Set E pin (or E2 pin)
+  * Used for mbed pins, I2C bus expander or SPI shiftregister
+  * Default PinName value for E2 is NC, must be used as pointer to avoid issues with mbed lib and DigitalOut pins
+  *   @param  value true or false
+  *   @return none 
+  */
+void TextLCD::_setEnable(bool value) {
+
+  if(_ctrl_idx==_LCDCtrl_0) {
+#if DEVICE_PORTOUT
+    if (_port_e != 0) {
+      if (value) {
+        _port_bus |= _port_e;    // Set E bit 
+      }  
+      else { 
+        _port_bus &= ~_port_e;   // Reset E bit  
+      }  
+      _port->write(_port_bus);
+      return;
+    }
+#endif
+
+    if (value) {
+      _e  = 1;    // Set E bit 
+    }  
+    else { 
+      _e  = 0;    // Reset E bit  
+    }  
+  }    
+  else { 
+    if (value) {
+      if (_e2 != NULL) {_e2->write(1);}  //Set E2 bit
+    }  
+    else { 
+      if (_e2 != NULL) {_e2->write(0);}  //Reset E2 bit     
+    }  
+  }    
+}    
+
+// Set RS pin
 // Used for mbed pins, I2C bus expander or SPI shiftregister
 void TextLCD::_setRS(bool value) {
 
+#if DEVICE_PORTOUT
+  if (_port_rs != 0) {
+    if (value) {
+      _port_bus |= _port_rs;    // Set RS bit 
+    }  
+    else  {
+      _port_bus &= ~_port_rs;   // Reset RS bit 
+    }  
+    _port->write(_port_bus);
+    return;
+  }
+#endif
+
   if (value) {
     _rs  = 1;    // Set RS bit 
   }  
@@ -3175,29 +4691,549 @@ void TextLCD::_setRS(bool value) {
   }  
 }    
 
-/** Set BL pin
-  * Used for mbed pins, I2C bus expander or SPI shiftregister
-  * Default PinName value is NC, must be used as pointer to avoid issues with mbed lib and DigitalOut pins
-  *   @param  value true or false
-  *   @return none  
+/** Set BL pin
+  * Used for mbed pins, I2C bus expander or SPI shiftregister
+  * Default PinName value is NC, must be used as pointer to avoid issues with mbed lib and DigitalOut pins
+  *   @param  value true or false
+  *   @return none  
+  */
+void TextLCD::_setBL(bool value) {
+
+  if (value) {
+    if (_bl != NULL) {_bl->write(1);}  //Set BL bit
+  }  
+  else { 
+    if (_bl != NULL) {_bl->write(0);}  //Reset BL bit  
+  }  
+}    
+
+// Place the 4bit data on the databus
+// Used for mbed pins, I2C bus expander or SPI shifregister
+void TextLCD::_setData(int value) {
+
+#if (LCD_BUS8 == 1)
+  if (_bus_dl == _LCD_DL_8) {
+    _setData8((value & 0x0F) << 4);   // Write Databits on D4..D7, D0..D3 are dont care
+    return;
+  }
+#endif
+
+#if DEVICE_PORTOUT
+  if (_port != NULL) {
+    _port_bus = (_port_bus & ~(0x0F << _port_shift)) | ((value & 0x0F) << _port_shift);
+    _port->write(_port_bus);   // Write Databits in one port access
+    return;
+  }
+#endif
+
+  _d = value & 0x0F;   // Write Databits 
+}    
+
+#if (LCD_BUS8 == 1)
+// Place the 8bit data on the databus
+// Used for mbed pins with an 8 bit databus
+void TextLCD::_setData8(int value) {
+
+#if DEVICE_PORTOUT
+  if (_port != NULL) {
+    _port_bus = (_port_bus & ~(0xFF << _port_shift)) | ((value & 0xFF) << _port_shift);
+    _port->write(_port_bus);   // Write Databits in one port access
+    return;
+  }
+#endif
+
+  _d = value & 0xFF;   // Write Databits 
+}    
+
+#endif
+
+// Write a byte using the 8-bit interface, only one Enable strobe is needed
+// The 4-bit interface uses two Enable strobes
+void TextLCD::_writeByte(int value) {
+
+#if DEVICE_PORTOUT
+  if ((_port_e != 0) && (_ctrl_idx == _LCDCtrl_0) && (_bus_dl == _LCD_DL_4)) {
+    // Databus, RS and E on one port: the data nibble is set together with the rising edge of E
+    int bus = _port_bus & ~(0x0F << _port_shift);
+    int hi  = bus | (((value >> 4) & 0x0F) << _port_shift);
+    int lo  = bus | ((value & 0x0F) << _port_shift);
+
+// Enable is Low
+    _port->write(hi | _port_e);   // High nibble
+    _delay_ns(LCD_BUS_NS); // Data setup time    
+    _port->write(hi);   
+    _delay_ns(LCD_BUS_NS); // Data hold time
+
+    _port->write(lo | _port_e);   // Low nibble
+    _delay_ns(LCD_BUS_NS); // Data setup time    
+    _port->write(lo);   
+    _delay_ns(LCD_BUS_NS); // Data hold time
+// Enable is Low
+
+    _port_bus = lo;
+    return;
+  }
+#endif
+
+  if (_bus_dl == _LCD_DL_4) {
+    TextLCD_Base::_writeByte(value);
+    return;
+  }
+
+#if (LCD_BUS8 == 1)
+// Enable is Low
+    this->_setEnable(true);          
+    this->_setData8(value);       // All bits
+    _delay_ns(LCD_BUS_NS); // Data setup time    
+    this->_setEnable(false);   
+    _delay_ns(LCD_BUS_NS); // Data hold time
+// Enable is Low
+#endif
+}
+
+// Read a byte using the 4-bit or 8-bit interface
+// Depending on the RS pin this byte will be the busy flag and address counter or data
+int TextLCD::_readByte() {
+  int value;
+
+  // Readback needs the RW pin
+  if (_rw == NULL) {
+    return -1;
+  }
+
+  _d.input();
+  _rw->write(1);
+  wait_us(1); // Address setup time
+
+#if (LCD_BUS8 == 1)
+  if (_bus_dl == _LCD_DL_8) {
+// Enable is Low
+    _setEnable(true);
+    wait_us(1); // Data delay time
+    value = (_d.read() & 0xFF);      // All bits
+    _setEnable(false);
+    wait_us(1); // Data hold time
+// Enable is Low
+
+    _rw->write(0);
+    _d.output();
+
+    return value;
+  }
+#endif
+
+// Enable is Low
+  _setEnable(true);
+  wait_us(1); // Data delay time
+  value = (_d.read() & 0x0F) << 4;   // High nibble
+  _setEnable(false);
+  wait_us(1); // Data hold time
+
+  _setEnable(true);
+  wait_us(1); // Data delay time
+  value |= (_d.read() & 0x0F);       // Low nibble
+  _setEnable(false);
+  wait_us(1); // Data hold time
+// Enable is Low
+
+  _rw->write(0);
+  _d.output();
+
+  return value;
+}
+
+//----------- End TextLCD ---------------
+
+
+//--------- Start Expander tables -------
+#if (LCD_I2C == 1) || (LCD_SPI == 1)
+// Lookup tables that map LCD data to the expander portpins of the selected hardware module (see TextLCD_Config.h)
+// The tables are generated at compile time from the LCD_BUS_I2C_Dx and LCD_BUS_SPI_Dx defines
+
+// Generate table entries M(0)..M(15) and M(0)..M(255)
+#define LCD_TBL16(M, h)  M((h)*16+0),  M((h)*16+1),  M((h)*16+2),  M((h)*16+3),  \
+                         M((h)*16+4),  M((h)*16+5),  M((h)*16+6),  M((h)*16+7),  \
+                         M((h)*16+8),  M((h)*16+9),  M((h)*16+10), M((h)*16+11), \
+                         M((h)*16+12), M((h)*16+13), M((h)*16+14), M((h)*16+15)
+#define LCD_TBL256(M)    LCD_TBL16(M, 0),  LCD_TBL16(M, 1),  LCD_TBL16(M, 2),  LCD_TBL16(M, 3),  \
+                         LCD_TBL16(M, 4),  LCD_TBL16(M, 5),  LCD_TBL16(M, 6),  LCD_TBL16(M, 7),  \
+                         LCD_TBL16(M, 8),  LCD_TBL16(M, 9),  LCD_TBL16(M, 10), LCD_TBL16(M, 11), \
+                         LCD_TBL16(M, 12), LCD_TBL16(M, 13), LCD_TBL16(M, 14), LCD_TBL16(M, 15)
+#endif
+
+#if (LCD_I2C == 1)
+// Databits for a nibble, and for the high and low nibble of a byte
+#define LCD_I2C_NIBBLE(n) ((((n) & 0x01) ? LCD_BUS_I2C_D4 : 0) | (((n) & 0x02) ? LCD_BUS_I2C_D5 : 0) | \
+                           (((n) & 0x04) ? LCD_BUS_I2C_D6 : 0) | (((n) & 0x08) ? LCD_BUS_I2C_D7 : 0))
+#define LCD_I2C_BYTE(b)   {LCD_I2C_NIBBLE((b) >> 4), LCD_I2C_NIBBLE((b) & 0x0F)}
+
+static const char _LCD_I2C_NIBBLE[16] = { LCD_TBL16(LCD_I2C_NIBBLE, 0) };
+#if (LCD_BYTE_TABLE == 1)
+static const char _LCD_I2C_BYTE[256][2] = { LCD_TBL256(LCD_I2C_BYTE) };
+#endif
+#endif
+
+#if (LCD_SPI == 1)
+// Databits for a nibble, and for the high and low nibble of a byte
+#define LCD_SPI_NIBBLE(n) ((((n) & 0x01) ? LCD_BUS_SPI_D4 : 0) | (((n) & 0x02) ? LCD_BUS_SPI_D5 : 0) | \
+                           (((n) & 0x04) ? LCD_BUS_SPI_D6 : 0) | (((n) & 0x08) ? LCD_BUS_SPI_D7 : 0))
+#define LCD_SPI_BYTE(b)   {LCD_SPI_NIBBLE((b) >> 4), LCD_SPI_NIBBLE((b) & 0x0F)}
+
+static const char _LCD_SPI_NIBBLE[16] = { LCD_TBL16(LCD_SPI_NIBBLE, 0) };
+#if (LCD_BYTE_TABLE == 1)
+static const char _LCD_SPI_BYTE[256][2] = { LCD_TBL256(LCD_SPI_BYTE) };
+#endif
+#endif
+
+#if (LCD_SPI_N == 1) || (LCD_SPI_N_3_8 == 1) || (LCD_SPI_N_3_9 == 1) || (LCD_SPI_N_3_10 == 1) || (LCD_SPI_N_3_16 == 1) || (LCD_SPI_N_3_24 == 1)
+/** Set the SPI clock and the chip select timing of the native SPI controller
+  *  The CS setup and hold times and the max clock are the datasheet minimum cycle times, rounded up.
+  *  The clock is limited to the max of the controller and to LCD_SPI_MAX_HZ for the board.
+  *  @param SPI *spi       SPI bus
+  *  @param int frequency  Requested SPI clock in Hz, 0 selects the fastest clock supported by the controller
+  *  @param int bits       Number of SPI bits to write one byte to the LCD
+  *  @return none
+  */
+void TextLCD_Base::_setFrequencySPI(SPI *spi, int frequency, int bits) {
+  int max;
+
+  switch (_ctrl) {
+    case ST7032_3V3:
+    case ST7032_5V:
+    case SPLC792A_3V3:
+    case ST7036_3V3:
+    case ST7036_5V:
+      _cs_setup_ns = 60;      // tCSS
+      _cs_hold_ns  = 60;      // tCSH
+      max = 2500000;          // tSCYC 400ns
+      break;
+
+    case SSD1803_3V3:
+    case US2066_3V3:
+      _cs_setup_ns = 100;
+      _cs_hold_ns  = 100;
+      max = 2000000;          // tCYCLE 500ns at 3V3
+      break;
+
+    case KS0073:
+    case KS0078:
+      _cs_setup_ns = 100;
+      _cs_hold_ns  = 100;
+      max = 2000000;          // tSCYC 500ns
+      break;
+
+    default:
+      // AIP31068, HD66712, PT6314, ST7070, WS0010 and others
+      _cs_setup_ns = 500;
+      _cs_hold_ns  = 500;
+      max = 1000000;          // tSCYC 1000ns
+      break;
+  }
+
+  if (max > LCD_SPI_MAX_HZ) {
+    max = LCD_SPI_MAX_HZ;
+  }
+
+  if ((frequency <= 0) || (frequency > max)) {
+    frequency = max;
+  }
+
+  spi->frequency(frequency);
+
+  _spi_hz = frequency;
+  _frame_ns = bits * (1000000000 / frequency);
+
+  // Bus timing estimate: the SPI frame, CS setup and hold, rounded up
+  _byte_us = ((bits * 1000000) + frequency - 1) / frequency + ((_cs_setup_ns + _cs_hold_ns + 999) / 1000);
+}
+#endif
+
+#if (LCD_SPI3_PACK == 1) && ((LCD_SPI_N_3_9 == 1) || (LCD_SPI_N_3_10 == 1) || (LCD_SPI_N_3_16 == 1))
+/** Write a run of data bytes as one packed SPI3 bitstream
+  *  Each byte is a word of the control bits and the data, the words are packed MSB first into a single block write.
+  *  The mbed block write is byte based, so the bus is set to 8 bit frames for the run. The last byte is padded
+  *  with zero bits, the controller discards the incomplete word when CS goes high. The SPI clock is lowered
+  *  for the run when needed, so that each word takes at least the execution time of the controller.
+  *  @param SPI *spi         SPI bus
+  *  @param DigitalOut *cs   Chip select pin (active low)
+  *  @param int format       SPI frame width used by the interface
+  *  @param int mode         SPI mode
+  *  @param int bits         Number of bits in a word (9, 10 or 16)
+  *  @param int control_cmd  Control bits for a command (RS=0) placed above the command byte
+  *  @param int control      Control bits for data (RS=1) placed above the data byte
+  *  @param int command      Set address command, -1 for none
+  *  @param const char *data Data bytes
+  *  @param int len          Number of bytes
+  *  @return none
+  */
+void TextLCD_Base::_writeRunSPI3(SPI *spi, DigitalOut *cs, int format, int mode, int bits, int control_cmd, int control, int command, const char *data, int len) {
+  int us = _timing.normal;
+  int hz = _spi_hz;
+  char packed[82];            // Packed words for a command and a chunk of 40 bytes of max 16 bits
+  uint32_t word;
+  uint32_t acc = 0;           // Bit accumulator
+  int acc_bits, cnt, n;
+
+  if ((_ops != NULL) || ((len + ((command >= 0) ? 1 : 0)) < 2)) {
+    // Captured operations are written one at a time
+    TextLCD_Base::_writeDataRun(command, data, len);
+    return;
+  }
+
+  // Each word must take at least the execution time
+  if ((us > 0) && (((bits * 1000000) / us) < hz)) {
+    hz = (bits * 1000000) / us;
+  }
+
+  // Wait until the controller has completed the previous instruction
+  _waitBusy();
+
+  _busLock();
+
+  spi->format(8, mode);
+  spi->frequency(hz);
+
+  while ((len > 0) || (command >= 0)) {
+    cnt = (len > 40) ? 40 : len;
+
+    // Pack the words, MSB first
+    acc_bits = 0;
+    n = 0;
+    for (int i=((command >= 0) ? -1 : 0); i<cnt; i++) {
+      if (i < 0) {
+        word = ((control_cmd << 8) | (command & 0xFF)) & ((1 << bits) - 1);
+        command = -1;
+      }
+      else {
+        word = ((control << 8) | (data[i] & 0xFF)) & ((1 << bits) - 1);
+      }
+      acc = (acc << bits) | word;
+      acc_bits += bits;
+
+      while (acc_bits >= 8) {
+        acc_bits -= 8;
+        packed[n++] = (acc >> acc_bits) & 0xFF;
+      }
+    }
+
+    if (acc_bits > 0) {
+      packed[n++] = (acc << (8 - acc_bits)) & 0xFF;  // Pad the last byte
+    }
+
+    *cs = 0;
+    _delay_ns(_cs_setup_ns);  // CS setup
+    spi->write(packed, n, NULL, 0);
+    _delay_ns(_cs_hold_ns);   // CS hold
+    *cs = 1;
+
+    data += cnt;
+    len -= cnt;
+
+    if (len > 0) {
+      _delay_us(us);          // Execution time of the last word in the chunk
+    }
+  }
+
+  // Restore the frame width and clock of the interface
+  spi->format(format, mode);
+  spi->frequency(_spi_hz);
+
+  _busUnlock();
+
+  // Execution time of the last byte
+  _wait_us(us);
+}
+#endif
+
+#if (LCD_I2C == 1) || (LCD_I2C16 == 1) || (LCD_I2C_N == 1)
+/** Select the I2C clock
+  *  The clock is limited to the max of the expander or controller and to LCD_I2C_MAX_HZ for the board.
+  *  @param int frequency  Requested I2C clock in Hz, 0 selects the fastest supported clock
+  *  @param int max        Max I2C clock in Hz of the expander or controller
+  *  @return int           Selected I2C clock in Hz
+  */
+int TextLCD_Base::_maxFrequencyI2C(int frequency, int max) {
+
+  if (max > LCD_I2C_MAX_HZ) {
+    max = LCD_I2C_MAX_HZ;
+  }
+
+  if ((frequency <= 0) || (frequency > max)) {
+    frequency = max;
+  }
+
+  return frequency;
+}
+
+/** Set the I2C clock and the bus timing estimate
+  *  @param I2C *i2c       I2C bus
+  *  @param int frequency  I2C clock in Hz
+  *  @param int bits       Number of I2C bits to write one byte to the LCD
+  *  @return none
+  */
+void TextLCD_Base::_setFrequencyI2C(I2C *i2c, int frequency, int bits) {
+
+  i2c->frequency(frequency);
+
+  _i2c_hz = frequency;
+  _i2c_bus = i2c;
+  _i2c_bus_hz = frequency;
+  _byte_us = ((bits * 1000000) + frequency - 1) / frequency;  // Bus timing estimate, rounded up
+}
+
+// Last I2C bus and clock set by a display
+I2C *TextLCD_Base::_i2c_bus = NULL;
+int TextLCD_Base::_i2c_bus_hz = 0;
+
+// Restore the I2C clock of this display when another display on the bus has changed it
+void TextLCD_Base::_selectFrequencyI2C(I2C *i2c) {
+
+  if ((i2c != _i2c_bus) || (_i2c_hz != _i2c_bus_hz)) {
+    i2c->frequency(_i2c_hz);
+    _i2c_bus = i2c;
+    _i2c_bus_hz = _i2c_hz;
+  }
+}
+
+/** Find the fastest I2C clock that is ACKed by the device
+  *  The test frame is written at decreasing standard clocks until it is ACKed LCD_I2C_PROBE times in a row.
+  *  @param I2C *i2c         I2C bus
+  *  @param char address     I2C slave address
+  *  @param int frequency    Fastest I2C clock in Hz to test
+  *  @param const char *data Test frame, it must not change the state of the LCD
+  *  @param int length       Length of the test frame
+  *  @param int bits         Number of I2C bits to write one byte to the LCD
+  *  @param bool ack         Device ACKs its slave address, the first clock is selected when false
+  *  @return int             Selected I2C clock in Hz, 0 when the device did not ACK at 100kHz
+  */
+int TextLCD_Base::_probeFrequencyI2C(I2C *i2c, char address, int frequency, const char *data, int length, int bits, bool ack) {
+  int i;
+
+  while (true) {
+    _setFrequencyI2C(i2c, frequency, bits);
+
+    if (ack) {
+      // Test frames return 0 on ACK
+      for (i=0; i<LCD_I2C_PROBE; i++) {
+        if (i2c->write(address, data, length) != 0) {
+          break;
+        }
+      }
+    }
+    else {
+      // The device does not ACK, assume that the first clock works
+      i = LCD_I2C_PROBE;
+    }
+
+    if (i == LCD_I2C_PROBE) {
+      return frequency;           // All test frames ACKed
+    }
+
+    // NACK, fall back to the next standard clock
+    if (frequency > 400000) {
+      frequency = 400000;         // Fast mode
+    }
+    else if (frequency > 100000) {
+      frequency = 100000;         // Standard mode
+    }
+    else {
+      return 0;                   // No response, the bus stays at the lowest clock
+    }
+  }
+}
+#endif
+
+#if (LCD_I2C == 1) || (LCD_SPI == 1)
+#if (LCD_BYTE_TABLE == 1)
+#define LCD_BYTE_TBL(t) (t)
+#else
+#define LCD_BYTE_TBL(t) NULL
+#endif
+
+// Pin mappings of the module selected in TextLCD_Config.h, these use the tables above
+#if (LCD_I2C == 1)
+static const TextLCD_Base::LCDPinMap _pinmap_I2C = {LCD_BUS_I2C_D4, LCD_BUS_I2C_D5, LCD_BUS_I2C_D6, LCD_BUS_I2C_D7,
+                                                    LCD_BUS_I2C_RS, LCD_BUS_I2C_E,  LCD_BUS_I2C_E2, LCD_BUS_I2C_BL, LCD_BUS_I2C_RW,
+                                                    (MCP23008 == 1), (BACKLIGHT_INV == 1)};
+#endif
+#if (LCD_SPI == 1)
+static const TextLCD_Base::LCDPinMap _pinmap_SPI = {LCD_BUS_SPI_D4, LCD_BUS_SPI_D5, LCD_BUS_SPI_D6, LCD_BUS_SPI_D7,
+                                                    LCD_BUS_SPI_RS, LCD_BUS_SPI_E,  LCD_BUS_SPI_E2, LCD_BUS_SPI_BL, LCD_BUS_SPI_RW,
+                                                    false, (BACKLIGHT_INV == 1)};
+#endif
+
+#if (LCD_PINMAP == 1)
+// Pin mappings for commercially available expander modules, see TextLCD_Config.h
+//                                                             D4      D5      D6      D7      RS      E       E2      BL      RW      MCP23008 BL_INV
+const TextLCD_Base::LCDPinMap TextLCD_Base::PinMap_DEFAULT      = {1 << 0, 1 << 1, 1 << 2, 1 << 3, 1 << 4, 1 << 5, 1 << 6, 1 << 7, 1 << 6, false,   false};
+const TextLCD_Base::LCDPinMap TextLCD_Base::PinMap_ADAFRUIT     = {1 << 3, 1 << 4, 1 << 5, 1 << 6, 1 << 1, 1 << 2, 1 << 0, 1 << 7, 1 << 0, true,    false};
+const TextLCD_Base::LCDPinMap TextLCD_Base::PinMap_ADAFRUIT_SPI = {1 << 6, 1 << 5, 1 << 4, 1 << 3, 1 << 1, 1 << 2, 1 << 0, 1 << 7, 1 << 0, false,   false};
+const TextLCD_Base::LCDPinMap TextLCD_Base::PinMap_DFROBOT      = {1 << 4, 1 << 5, 1 << 6, 1 << 7, 1 << 0, 1 << 2, 1 << 1, 1 << 3, 1 << 1, false,   false};
+const TextLCD_Base::LCDPinMap TextLCD_Base::PinMap_LCM1602      = {1 << 4, 1 << 5, 1 << 6, 1 << 7, 1 << 0, 1 << 2, 1 << 1, 1 << 3, 1 << 1, false,   true };
+const TextLCD_Base::LCDPinMap TextLCD_Base::PinMap_YWROBOT      = {1 << 4, 1 << 5, 1 << 6, 1 << 7, 1 << 0, 1 << 2, 1 << 1, 1 << 3, 1 << 1, false,   true };
+const TextLCD_Base::LCDPinMap TextLCD_Base::PinMap_fc113        = {1 << 4, 1 << 5, 1 << 6, 1 << 7, 1 << 0, 1 << 2, 1 << 1, 1 << 3, 1 << 1, false,   true };
+const TextLCD_Base::LCDPinMap TextLCD_Base::PinMap_GYLCD        = {1 << 0, 1 << 1, 1 << 2, 1 << 3, 1 << 6, 1 << 4, 1 << 5, 1 << 7, 1 << 5, false,   true };
+const TextLCD_Base::LCDPinMap TextLCD_Base::PinMap_MJKDZ        = {1 << 0, 1 << 1, 1 << 2, 1 << 3, 1 << 6, 1 << 4, 1 << 5, 1 << 7, 1 << 5, false,   true };
+const TextLCD_Base::LCDPinMap TextLCD_Base::PinMap_SYDZ         = {1 << 4, 1 << 5, 1 << 6, 1 << 7, 1 << 0, 1 << 2, 1 << 1, 1 << 3, 1 << 1, false,   false};
+const TextLCD_Base::LCDPinMap TextLCD_Base::PinMap_WIDEHK       = {1 << 0, 1 << 1, 1 << 2, 1 << 3, 1 << 4, 1 << 7, 1 << 5, 1 << 6, 1 << 5, true,    false};
+const TextLCD_Base::LCDPinMap TextLCD_Base::PinMap_LCDPLUG      = {1 << 0, 1 << 1, 1 << 2, 1 << 3, 1 << 4, 1 << 6, 1 << 5, 1 << 7, 1 << 5, true,    false};
+#endif
+
+/** Init the expander pin mapping
+  *  A runtime mapping gets its own lookup tables, computed once so that the bus writes use the same table lookups as the default mapping.
+  *  @param _LCDExpander *exp        Expander pin mapping to init
+  *  @param const LCDPinMap *map     Runtime mapping, NULL selects the default mapping and tables
+  *  @param const LCDPinMap *def     Default mapping, selected in TextLCD_Config.h
+  *  @param const char *nibble       Default nibble table
+  *  @param const char (*byte)[2]    Default byte table, NULL without LCD_BYTE_TABLE
+  *  @return none
   */
-void TextLCD::_setBL(bool value) {
+void TextLCD_Base::_initExpander(_LCDExpander *exp, const LCDPinMap *map, const LCDPinMap *def, const char *nibble, const char (*byte)[2]) {
+  char *tables;
+
+  if (map == NULL) {
+    // Mapping selected in TextLCD_Config.h, use the compile time tables
+    exp->map = *def;
+    exp->nibble = nibble;
+#if (LCD_BYTE_TABLE == 1)
+    exp->byte = byte;
+#else
+    (void) byte;    // No byte table
+#endif
+    exp->tables = NULL;
+  }
+  else {
+    exp->map = *map;
 
-  if (value) {
-    if (_bl != NULL) {_bl->write(1);}  //Set BL bit
-  }  
-  else { 
-    if (_bl != NULL) {_bl->write(0);}  //Reset BL bit  
-  }  
-}    
+#if (LCD_BYTE_TABLE == 1)
+    tables = new char[16 + 512];
+#else
+    tables = new char[16];
+#endif
 
-// Place the 4bit data on the databus
-// Used for mbed pins, I2C bus expander or SPI shifregister
-void TextLCD::_setData(int value) {
-  _d = value & 0x0F;   // Write Databits 
-}    
+    // Nibble table
+    for (int n=0; n<16; n++) {
+      tables[n] = ((n & 0x01) ? map->d4 : 0) | ((n & 0x02) ? map->d5 : 0) |
+                  ((n & 0x04) ? map->d6 : 0) | ((n & 0x08) ? map->d7 : 0);
+    }
 
-//----------- End TextLCD ---------------
+#if (LCD_BYTE_TABLE == 1)
+    // Byte table, high and low nibble
+    for (int b=0; b<256; b++) {
+      tables[16 + (2 * b)]     = tables[b >> 4];
+      tables[16 + (2 * b) + 1] = tables[b & 0x0F];
+    }
+    exp->byte = (const char (*)[2]) &tables[16];
+#endif
+
+    exp->nibble = tables;
+    exp->tables = tables;
+  }
+
+  exp->d_msk = exp->map.d4 | exp->map.d5 | exp->map.d6 | exp->map.d7;
+}
+#endif
+//---------- End Expander tables --------
 
 
 //--------- Start TextLCD_I2C -----------
@@ -3208,51 +5244,81 @@ void TextLCD::_setData(int value) {
   * @param deviceAddress   I2C slave address (PCF8574, PCF8574A or MCP23008, default = 0x40)
   * @param type            Sets the panel size/addressing mode (default = LCD16x2)
   * @param ctrl            LCD controller (default = HD44780)    
+  * @param map             Pin mapping of the expander module (default = NULL, the module selected in TextLCD_Config.h)
+  * @param frequency       Max I2C clock in Hz (default = 0, the fastest clock supported by the expander and LCD_I2C_MAX_HZ)
   */
-TextLCD_I2C::TextLCD_I2C(I2C *i2c, char deviceAddress, LCDType type, LCDCtrl ctrl) :
+TextLCD_I2C::TextLCD_I2C(I2C *i2c, char deviceAddress, LCDType type, LCDCtrl ctrl, const LCDPinMap *map, int frequency) :
                          TextLCD_Base(type, ctrl), 
                          _i2c(i2c){
                               
   _slaveAddress = deviceAddress & 0xFE;
 
+  // Pin mapping and lookup tables
+  _initExpander(&_exp, map, &_pinmap_I2C, _LCD_I2C_NIBBLE, LCD_BYTE_TBL(_LCD_I2C_BYTE));
+
   // Setup the I2C bus
-  // The max bitrate for PCF8574 is 100kbit, the max bitrate for MCP23008 is 400kbit, 
-  _i2c->frequency(100000);
+  // The max bitrate for PCF8574 is 100kbit, the max bitrate for MCP23008 is 400kbit (1.7Mbit in HS mode)
+  _setFrequencyI2C(_i2c, _maxFrequencyI2C(frequency, _exp.map.mcp23008 ? MCP23008_MAX_HZ : PCF8574_MAX_HZ), _exp.map.mcp23008 ? 85 : 70);
   
-#if (MCP23008==1)
-  // MCP23008 portexpander Init
-  _writeRegister(IODIR,   0x00);  // All pins are outputs
-  _writeRegister(IPOL,    0x00);  // No reverse polarity on inputs
-  _writeRegister(GPINTEN, 0x00);  // No interrupt on change of input pins
-  _writeRegister(DEFVAL,  0x00);  // Default value to compare against for interrupts
-  _writeRegister(INTCON,  0x00);  // No interrupt on changes, compare against previous pin value 
-  _writeRegister(IOCON,   0x20);  // b1=0 - Interrupt polarity active low  
-                                  // b2=0 - Interrupt pin active driver output  
-                                  // b4=0 - Slew rate enable on SDA
-                                  // b5=0 - Auto-increment on registeraddress                                  
-                                  // b5=1 - No auto-increment on registeraddress => needed for performance improved I2C expander mode
-  _writeRegister(GPPU,    0x00);  // No Pullup 
-//               INTF             // Interrupt flags read (Read-Only)
-//               INTCAP           // Captured inputpins at time of interrupt (Read-Only)   
-//  _writeRegister(GPIO,    0x00);  // Output/Input pins   
-//  _writeRegister(OLAT,    0x00);  // Output Latch  
+  if (_exp.map.mcp23008) {
+    // MCP23008 portexpander Init
+    _writeRegister(IODIR,   0x00);  // All pins are outputs
+    _writeRegister(IPOL,    0x00);  // No reverse polarity on inputs
+    _writeRegister(GPINTEN, 0x00);  // No interrupt on change of input pins
+    _writeRegister(DEFVAL,  0x00);  // Default value to compare against for interrupts
+    _writeRegister(INTCON,  0x00);  // No interrupt on changes, compare against previous pin value 
+    _writeRegister(IOCON,   0x20);  // b1=0 - Interrupt polarity active low  
+                                    // b2=0 - Interrupt pin active driver output  
+                                    // b4=0 - Slew rate enable on SDA
+                                    // b5=0 - Auto-increment on registeraddress                                  
+                                    // b5=1 - No auto-increment on registeraddress => needed for performance improved I2C expander mode
+    _writeRegister(GPPU,    0x00);  // No Pullup 
+  //               INTF             // Interrupt flags read (Read-Only)
+  //               INTCAP           // Captured inputpins at time of interrupt (Read-Only)   
+  //  _writeRegister(GPIO,    0x00);  // Output/Input pins   
+  //  _writeRegister(OLAT,    0x00);  // Output Latch  
+  }
     
-  // Init the portexpander bus
-  _lcd_bus = LCD_BUS_I2C_DEF;
+  // Init the portexpander bus, Backlight off
+  _lcd_bus = _exp.map.bl_inv ? _exp.map.bl : 0x00;
   
   // write the new data to the portexpander
-  _writeRegister(GPIO, _lcd_bus);      
-#else
-  // PCF8574 of PCF8574A portexpander
+  _writeBus();
 
-  // Init the portexpander bus
-  _lcd_bus = LCD_BUS_I2C_DEF;
+  _init(_LCD_DL_4);   // Set Datalength to 4 bit for all serial expander interfaces
+}
 
-  // write the new data to the portexpander
-  _i2c->write(_slaveAddress, &_lcd_bus, 1);    
-#endif
+/** Destruct a TextLCD interface using an I2C PCF8574 (or PCF8574A) or MCP23008 portexpander
+  *
+  * @param  none
+  * @return none
+  */ 
+TextLCD_I2C::~TextLCD_I2C() {
+  if (_exp.tables != NULL) {delete[] _exp.tables;}  // Lookup tables for a runtime mapping
+}
 
-  _init(_LCD_DL_4);   // Set Datalength to 4 bit for all serial expander interfaces
+/** Find the fastest I2C clock that works for the portexpander
+  *  Test writes are sent at decreasing clocks, starting at the requested clock, until they are ACKed.
+  *
+  * @param frequency       Max I2C clock in Hz to test (default = 0, the fastest clock supported by the expander and LCD_I2C_MAX_HZ)
+  * @return                Selected I2C clock in Hz, 0 when the portexpander does not respond
+  */
+int TextLCD_I2C::probeFrequency(int frequency) {
+  char data[2];
+  int i = 0;
+
+  // Test frame rewrites the current databus shadowvalue
+  if (_exp.map.mcp23008) {
+    data[i++] = GPIO;             // set registeraddress
+  }
+  data[i++] = _lcd_bus;
+
+  _busLock();
+  frequency = _probeFrequencyI2C(_i2c, _slaveAddress, _maxFrequencyI2C(frequency, _exp.map.mcp23008 ? MCP23008_MAX_HZ : PCF8574_MAX_HZ),
+                                 data, i, _exp.map.mcp23008 ? 85 : 70, true);  // Bus timing: RS and four Enable strobe frames
+  _busUnlock();
+
+  return frequency;
 }
 
 // Set E bit (or E2 bit) in the databus shadowvalue
@@ -3262,27 +5328,27 @@ void TextLCD_I2C::_setEnableBit(bool value) {
 #if (LCD_TWO_CTRL == 1)
   if(_ctrl_idx==_LCDCtrl_0) {
     if (value) {
-      _lcd_bus |= LCD_BUS_I2C_E;     // Set E bit 
+      _lcd_bus |= _exp.map.e;     // Set E bit 
     }  
     else {                    
-      _lcd_bus &= ~LCD_BUS_I2C_E;    // Reset E bit                     
+      _lcd_bus &= ~_exp.map.e;    // Reset E bit                     
     }  
   }
   else {
     if (value) {
-      _lcd_bus |= LCD_BUS_I2C_E2;    // Set E2 bit 
+      _lcd_bus |= _exp.map.e2;    // Set E2 bit 
     }  
     else {
-      _lcd_bus &= ~LCD_BUS_I2C_E2;   // Reset E2bit                     
+      _lcd_bus &= ~_exp.map.e2;   // Reset E2bit                     
     }  
   }    
 #else
 // Support only one controller
   if (value) {
-    _lcd_bus |= LCD_BUS_I2C_E;     // Set E bit 
+    _lcd_bus |= _exp.map.e;     // Set E bit 
   }  
   else {                    
-    _lcd_bus &= ~LCD_BUS_I2C_E;    // Reset E bit                     
+    _lcd_bus &= ~_exp.map.e;    // Reset E bit                     
   }  
 
 #endif  
@@ -3295,17 +5361,8 @@ void TextLCD_I2C::_setEnable(bool value) {
   // Place the E or E2 bit data on the databus shadowvalue
   _setEnableBit(value);
 
-#if (MCP23008==1)
-  // MCP23008 portexpander
-  
-  // write the new data to the portexpander
-  _writeRegister(GPIO, _lcd_bus);      
-#else
-  // PCF8574 of PCF8574A portexpander
-
   // write the new data to the I2C portexpander
-  _i2c->write(_slaveAddress, &_lcd_bus, 1);    
-#endif
+  _writeBus();
 }    
 
 
@@ -3314,192 +5371,434 @@ void TextLCD_I2C::_setEnable(bool value) {
 void TextLCD_I2C::_setRS(bool value) {
 
   if (value) {
-    _lcd_bus |= LCD_BUS_I2C_RS;    // Set RS bit 
+    _lcd_bus |= _exp.map.rs;    // Set RS bit 
   }  
   else {                    
-    _lcd_bus &= ~LCD_BUS_I2C_RS;   // Reset RS bit                     
+    _lcd_bus &= ~_exp.map.rs;   // Reset RS bit                     
   }
 
-#if (MCP23008==1)
-  // MCP23008 portexpander
-  
-  // write the new data to the portexpander
-  _writeRegister(GPIO, _lcd_bus);      
-#else
-  // PCF8574 of PCF8574A portexpander
-
   // write the new data to the I2C portexpander
-  _i2c->write(_slaveAddress, &_lcd_bus, 1);    
-#endif                  
+  _writeBus();
 }    
 
 // Set BL pin
 // Used for mbed pins, I2C bus expander or SPI shiftregister
 void TextLCD_I2C::_setBL(bool value) {
 
+  // The Backlight logic of this module differs from the module selected in TextLCD_Config.h
+  if (_exp.map.bl_inv != (BACKLIGHT_INV == 1)) {
+    value = !value;
+  }
+
   if (value) {
-    _lcd_bus |= LCD_BUS_I2C_BL;    // Set BL bit 
+    _lcd_bus |= _exp.map.bl;    // Set BL bit 
   }  
   else {                    
-    _lcd_bus &= ~LCD_BUS_I2C_BL;   // Reset BL bit                     
+    _lcd_bus &= ~_exp.map.bl;   // Reset BL bit                     
   }
   
-#if (MCP23008==1)
-  // MCP23008 portexpander
-  
-  // write the new data to the portexpander
-  _writeRegister(GPIO, _lcd_bus);      
-#else
-  // PCF8574 of PCF8574A portexpander
-
   // write the new data to the I2C portexpander
-  _i2c->write(_slaveAddress, &_lcd_bus, 1);    
-#endif                 
+  _writeBus();
 }    
 
-#if(0)
-// New optimized v018
-// Test faster _writeByte 0.11s vs 0.27s for a 20x4 fillscreen (PCF8574), same as v018
 // Place the 4bit data in the databus shadowvalue
 // Used for mbed I2C bus expander
-const char _LCD_DATA_BITS[16] = {
-      0x00,
-      (                                                   LCD_BUS_I2C_D4),
-      (                                  LCD_BUS_I2C_D5                 ),
-      (                                  LCD_BUS_I2C_D5 | LCD_BUS_I2C_D4),
-      (                 LCD_BUS_I2C_D6                                  ),                  
-      (                 LCD_BUS_I2C_D6                  | LCD_BUS_I2C_D4),
-      (                 LCD_BUS_I2C_D6 | LCD_BUS_I2C_D5                 ),
-      (                 LCD_BUS_I2C_D6 | LCD_BUS_I2C_D5 | LCD_BUS_I2C_D4),
-      (LCD_BUS_I2C_D7                                                   ),
-      (LCD_BUS_I2C_D7                                   | LCD_BUS_I2C_D4),
-      (LCD_BUS_I2C_D7                  | LCD_BUS_I2C_D5                 ),
-      (LCD_BUS_I2C_D7                  | LCD_BUS_I2C_D5 | LCD_BUS_I2C_D4),                  
-      (LCD_BUS_I2C_D7 | LCD_BUS_I2C_D6                                  ),
-      (LCD_BUS_I2C_D7 | LCD_BUS_I2C_D6                  | LCD_BUS_I2C_D4),
-      (LCD_BUS_I2C_D7 | LCD_BUS_I2C_D6 | LCD_BUS_I2C_D5                 ),
-      (LCD_BUS_I2C_D7 | LCD_BUS_I2C_D6 | LCD_BUS_I2C_D5 | LCD_BUS_I2C_D4)
-    };
 void TextLCD_I2C::_setDataBits(int value) {
 
-  //Clear all databits
-  _lcd_bus &= ~LCD_BUS_I2C_MSK;
+  // Clear all databits and set the databits from the lookup table, supports any mapping of expander portpins to LCD pins
+  _lcd_bus = (_lcd_bus & ~_exp.d_msk) | _exp.nibble[value & 0x0F];
+}    
+
+
+// Place the 4bit data on the databus
+// Used for mbed pins, I2C bus expander or SPI shifregister
+void TextLCD_I2C::_setData(int value) {
 
-  // Set bit by bit to support any mapping of expander portpins to LCD pins 
-  _lcd_bus |= _LCD_DATA_BITS[value & 0x0F];
+  // Place the 4bit data on the databus shadowvalue
+  _setDataBits(value); 
+  
+  // Place the 4bit data on the databus
+  // write the new data to the I2C portexpander
+  _writeBus();
 }    
-#endif
 
-// Test faster _writeByte 0.11s vs 0.27s for a 20x4 fillscreen (PCF8574)
-// Place the 4bit data in the databus shadowvalue
+// Write the databus shadowvalue to the I2C portexpander
+void TextLCD_I2C::_writeBus() {
+
+  _selectFrequencyI2C(_i2c);
+
+  if (_exp.map.mcp23008) {
+    // MCP23008 portexpander
+    _writeRegister(GPIO, _lcd_bus);      
+  }
+  else {
+    // PCF8574 of PCF8574A portexpander
+    _i2c->write(_slaveAddress, &_lcd_bus, 1);    
+  }
+}
+
+// Write data to MCP23008 I2C portexpander
 // Used for mbed I2C bus expander
-void TextLCD_I2C::_setDataBits(int value) {
+void TextLCD_I2C::_writeRegister (int reg, int value) {
+  char data[] = {reg, value};
+    
+  _selectFrequencyI2C(_i2c);
+  _i2c->write(_slaveAddress, data, 2); 
+}
 
-  //Clear all databits
-  _lcd_bus &= ~LCD_BUS_I2C_MSK;
+//New optimized
+//Test faster _writeByte 0.11s vs 0.27s for a 20x4 fillscreen (PCF8574)
+//Test faster _writeByte 0.14s vs 0.34s for a 20x4 fillscreen (MCP23008)
 
-  // Set bit by bit to support any mapping of expander portpins to LCD pins 
-  if (value & 0x01){
-    _lcd_bus |= LCD_BUS_I2C_D4;   // Set Databit 
-  }  
+// Write a byte using I2C
+void TextLCD_I2C::_writeByte(int value) {
+  char data[5];
+  int i = 0;
+  
+  if (_exp.map.mcp23008) {
+    // MCP23008 portexpander
+    data[i++] = GPIO;             // set registeraddres
+                                  // Note: auto-increment is disabled so all data will go to GPIO register
+  }
+  
+  i = _encodeByte(data, i, value);
+  
+  // write the packed data to the I2C portexpander
+  _selectFrequencyI2C(_i2c);
+  _i2c->write(_slaveAddress, data, i);    
+}
+
+// Place the four Enable strobe frames of a byte in a buffer
+int TextLCD_I2C::_encodeByte(char *frames, int n, int value) {
+#if (LCD_BYTE_TABLE == 1)
+  const char *bits = _exp.byte[value & 0xFF];   // Databits for the high and low nibble
+#else
+  const char bits[2] = {_exp.nibble[(value >> 4) & 0x0F], _exp.nibble[value & 0x0F]};
+#endif
+
+  _setEnableBit(true);            // set E 
+  _lcd_bus = (_lcd_bus & ~_exp.d_msk) | bits[0];  // set data high  
+  frames[n++] = _lcd_bus;
+  
+  _setEnableBit(false);           // clear E   
+  frames[n++] = _lcd_bus;
+  
+  _setEnableBit(true);            // set E   
+  _lcd_bus = (_lcd_bus & ~_exp.d_msk) | bits[1];  // set data low    
+  frames[n++] = _lcd_bus;
+  
+  _setEnableBit(false);           // clear E     
+  frames[n++] = _lcd_bus;
+
+  return n;
+}
+
+#if (LCD_TX == 1)
+// Write an optional set address command and a run of data bytes using I2C
+// The strobe frames of the command and the data are concatenated in the same I2C write. This is only used when
+// the two frames between the end of a byte and the first strobe of the next byte cover the execution time.
+void TextLCD_I2C::_writeDataRun(int command, const char *data, int len) {
+  char frames[2 + (4 * 16)];      // Register, RS frame and the strobe frames of 16 bytes
+  int us = _timing.normal;
+  int n = 0;
+
+  if ((_ops != NULL) || ((len + ((command >= 0) ? 1 : 0)) < 2) || (((18 * 1000000) / _i2c_hz) < us)) {
+    // Captured operations are written one at a time
+    TextLCD_Base::_writeDataRun(command, data, len);
+    return;
+  }
 
-  if (value & 0x02){
-    _lcd_bus |= LCD_BUS_I2C_D5;   // Set Databit 
+  // Wait until the controller has completed the previous instruction
+  _waitBusy();
+
+  _busLock();
+  _selectFrequencyI2C(_i2c);
+
+  if (_exp.map.mcp23008) {
+    frames[n++] = GPIO;           // set registeraddres
+  }
+
+  if (command >= 0) {
+    _lcd_bus &= ~_exp.map.rs;     // command mode
+    frames[n++] = _lcd_bus;       // RS setup
+    n = _encodeByte(frames, n, command);
+  }
+
+  _lcd_bus |= _exp.map.rs;        // data mode
+  frames[n++] = _lcd_bus;         // RS setup
+
+  for (int i=0; i<len; i++) {
+    if ((n + 4) > (int) sizeof(frames)) {
+      // write the packed data to the I2C portexpander, continue in the next I2C write
+      _i2c->write(_slaveAddress, frames, n);    
+      n = 0;
+      if (_exp.map.mcp23008) {
+        frames[n++] = GPIO;       // set registeraddres
+      }
+    }
+    n = _encodeByte(frames, n, data[i]);
+  }
+
+  // write the packed data to the I2C portexpander
+  _i2c->write(_slaveAddress, frames, n);    
+
+  _busUnlock();
+
+  // Execution time of the last byte
+  _wait_us(us);
+}
+
+#if (LCD_PLAN == 1)
+// Overhead of a data run using I2C: slaveaddress, registeraddress and the RS setup frames
+int TextLCD_I2C::_runCost() {
+
+  if (((18 * 1000000) / _i2c_hz) < _timing.normal) {
+    return 0;                     // Runs are written one byte at a time
+  }
+
+  return ((_exp.map.mcp23008 ? 36 : 27) * 1000000) / _i2c_hz;
+}
+#endif
+#endif
+
+#endif /* I2C Expander PCF8574/MCP23008 */
+//---------- End TextLCD_I2C ------------
+
+
+//--------- Start TextLCD_I2C16 ---------
+#if(LCD_I2C16 == 1) /* I2C Expander MCP23017/PCF8575 */
+/** Create a TextLCD interface using an I2C MCP23017 or PCF8575 16 bit portexpander
+  *
+  * @param i2c             I2C Bus
+  * @param deviceAddress   I2C slave address (MCP23017 or PCF8575, default = 0x40)
+  * @param type            Sets the panel size/addressing mode (default = LCD16x2)
+  * @param ctrl            LCD controller (default = HD44780)    
+  * @param frequency       Max I2C clock in Hz (default = 0, the fastest clock supported by the expander and LCD_I2C_MAX_HZ)
+  */
+TextLCD_I2C16::TextLCD_I2C16(I2C *i2c, char deviceAddress, LCDType type, LCDCtrl ctrl, int frequency) :
+                             TextLCD_Base(type, ctrl), 
+                             _i2c(i2c){
+                              
+  _slaveAddress = deviceAddress & 0xFE;
+
+  // Setup the I2C bus
+  // The max bitrate for PCF8575 is 400kbit, the max bitrate for MCP23017 is 400kbit (1.7Mbit in HS mode)
+#if (MCP23017==1)
+  _setFrequencyI2C(_i2c, _maxFrequencyI2C(frequency, MCP23017_MAX_HZ), 50);  // Bus timing: two Enable strobe frames, about 50 bits
+#else
+  _setFrequencyI2C(_i2c, _maxFrequencyI2C(frequency, PCF8575_MAX_HZ), 40);   // Bus timing: two Enable strobe frames, about 40 bits
+#endif
+  
+#if (MCP23017==1)
+  // MCP23017 portexpander Init
+  _writeRegister(MCP23017_IOCON,  0x20);  // b7=0 - BANK=0, registers of port A and B are paired
+                                          // b5=1 - No auto-increment on registeraddress, the address toggles between
+                                          //        the A and B register of a pair => needed for 16 bit bus writes
+  _writeRegister(MCP23017_IODIRA, 0x00);  // All pins are outputs
+  _writeRegister(MCP23017_IODIRB, 0x00);  // All pins are outputs
+#endif
+
+  // Init the portexpander bus
+  _lcd_bus = LCD_BUS_I2C16_DEF;
+
+  // write the new data to the portexpander
+  _writeBus();
+
+  _bus_dl = _LCD_DL_8;  // 8 bit databus to the controller
+
+  _init(_LCD_DL_8);   // Set Datalength to 8 bit for the 16 bit expander
+}
+
+/** Find the fastest I2C clock that works for the portexpander
+  *  Test writes are sent at decreasing clocks, starting at the requested clock, until they are ACKed.
+  *
+  * @param frequency       Max I2C clock in Hz to test (default = 0, the fastest clock supported by the expander and LCD_I2C_MAX_HZ)
+  * @return                Selected I2C clock in Hz, 0 when the portexpander does not respond
+  */
+int TextLCD_I2C16::probeFrequency(int frequency) {
+  char data[3];
+  int i = 0;
+
+  // Test frame rewrites the current databus shadowvalue
+#if (MCP23017==1)
+  data[i++] = MCP23017_GPIOA;          // set registeraddress
+#endif
+  data[i++] = _lcd_bus & 0xFF;         // Port A
+  data[i++] = (_lcd_bus >> 8) & 0xFF;  // Port B
+
+  _busLock();
+#if (MCP23017==1)
+  frequency = _probeFrequencyI2C(_i2c, _slaveAddress, _maxFrequencyI2C(frequency, MCP23017_MAX_HZ), data, i, 50, true);
+#else
+  frequency = _probeFrequencyI2C(_i2c, _slaveAddress, _maxFrequencyI2C(frequency, PCF8575_MAX_HZ), data, i, 40, true);
+#endif
+  _busUnlock();
+
+  return frequency;
+}
+
+// Set E bit (or E2 bit) in the databus shadowvalue
+// Used for mbed I2C bus expander
+void TextLCD_I2C16::_setEnableBit(bool value) {
+
+#if (LCD_TWO_CTRL == 1)
+  if(_ctrl_idx==_LCDCtrl_0) {
+    if (value) {
+      _lcd_bus |= LCD_BUS_I2C16_E;     // Set E bit 
+    }  
+    else {                    
+      _lcd_bus &= ~LCD_BUS_I2C16_E;    // Reset E bit                     
+    }  
+  }
+  else {
+    if (value) {
+      _lcd_bus |= LCD_BUS_I2C16_E2;    // Set E2 bit 
+    }  
+    else {
+      _lcd_bus &= ~LCD_BUS_I2C16_E2;   // Reset E2bit                     
+    }  
+  }    
+#else
+// Support only one controller
+  if (value) {
+    _lcd_bus |= LCD_BUS_I2C16_E;     // Set E bit 
+  }  
+  else {                    
+    _lcd_bus &= ~LCD_BUS_I2C16_E;    // Reset E bit                     
   }  
+#endif
+}    
+
+// Set E pin (or E2 pin)
+// Used for mbed pins, I2C bus expander or SPI shiftregister
+void TextLCD_I2C16::_setEnable(bool value) {
+
+  // Place the E or E2 bit data on the databus shadowvalue
+  _setEnableBit(value);
 
-  if (value & 0x04) {
-    _lcd_bus |= LCD_BUS_I2C_D6;   // Set Databit 
+  // write the new data to the I2C portexpander
+  _writeBus();
+}    
+
+// Set RS pin
+// Used for mbed pins, I2C bus expander or SPI shiftregister
+void TextLCD_I2C16::_setRS(bool value) {
+  int bus = _lcd_bus;
+
+  if (value) {
+    _lcd_bus |= LCD_BUS_I2C16_RS;    // Set RS bit 
   }  
+  else {                    
+    _lcd_bus &= ~LCD_BUS_I2C16_RS;   // Reset RS bit                     
+  }
+
+  if (_lcd_bus == bus) {
+    return;                          // RS unchanged, saves a frame for each character of a string
+  }
+
+  // write the new data to the I2C portexpander
+  _writeBus();
+}    
+
+// Set BL pin
+// Used for mbed pins, I2C bus expander or SPI shiftregister
+void TextLCD_I2C16::_setBL(bool value) {
 
-  if (value & 0x08) {
-    _lcd_bus |= LCD_BUS_I2C_D7;   // Set Databit 
+  if (value) {
+    _lcd_bus |= LCD_BUS_I2C16_BL;    // Set BL bit 
   }  
+  else {                    
+    _lcd_bus &= ~LCD_BUS_I2C16_BL;   // Reset BL bit                     
+  }
+
+  // write the new data to the I2C portexpander
+  _writeBus();
 }    
 
+// Expander portpins for each bit of the 8 bit databus
+static const int _LCD_DATA_BITS16[8] = {
+      LCD_BUS_I2C16_D0, LCD_BUS_I2C16_D1, LCD_BUS_I2C16_D2, LCD_BUS_I2C16_D3,
+      LCD_BUS_I2C16_D4, LCD_BUS_I2C16_D5, LCD_BUS_I2C16_D6, LCD_BUS_I2C16_D7
+};
+
+// Place the 8bit data in the databus shadowvalue
+// Used for mbed I2C bus expander
+void TextLCD_I2C16::_setDataBits(int value) {
+
+  // Set bit by bit to support any mapping of expander portpins to LCD pins
+  for (int i=0; i<8; i++) {
+    if (value & (1 << i)) {
+      _lcd_bus |= _LCD_DATA_BITS16[i];   // Set Databit 
+    }  
+    else {
+      _lcd_bus &= ~_LCD_DATA_BITS16[i];  // Reset Databit
+    }
+  }
+}    
 
 // Place the 4bit data on the databus
 // Used for mbed pins, I2C bus expander or SPI shifregister
-void TextLCD_I2C::_setData(int value) {
+void TextLCD_I2C16::_setData(int value) {
 
-  // Place the 4bit data on the databus shadowvalue
-  _setDataBits(value); 
-  
-  // Place the 4bit data on the databus
-#if (MCP23008==1)
-  // MCP23008 portexpander
+  // Place the 4bit data on D4..D7 in the databus shadowvalue, D0..D3 are dont care
+  _setDataBits((value & 0x0F) << 4);
   
-  // write the new data to the portexpander
-  _writeRegister(GPIO, _lcd_bus);      
-#else
-  // PCF8574 of PCF8574A portexpander
-
   // write the new data to the I2C portexpander
-  _i2c->write(_slaveAddress, &_lcd_bus, 1);    
-#endif                 
+  _writeBus();
 }    
 
-// Write data to MCP23008 I2C portexpander
+// Write the databus shadowvalue to the I2C portexpander
+void TextLCD_I2C16::_writeBus() {
+
+  _selectFrequencyI2C(_i2c);
+  char data[3];
+  int i = 0;
+
+#if (MCP23017==1)
+  data[i++] = MCP23017_GPIOA;          // set registeraddress
+#endif
+  data[i++] = _lcd_bus & 0xFF;         // Port A
+  data[i++] = (_lcd_bus >> 8) & 0xFF;  // Port B
+
+  _i2c->write(_slaveAddress, data, i);    
+}
+
+// Write data to MCP23017 I2C portexpander
 // Used for mbed I2C bus expander
-void TextLCD_I2C::_writeRegister (int reg, int value) {
-  char data[] = {reg, value};
+void TextLCD_I2C16::_writeRegister (int reg, int value) {
+  char data[] = {(char) reg, (char) value};
     
+  _selectFrequencyI2C(_i2c);
   _i2c->write(_slaveAddress, data, 2); 
 }
 
-//New optimized
-//Test faster _writeByte 0.11s vs 0.27s for a 20x4 fillscreen (PCF8574)
-//Test faster _writeByte 0.14s vs 0.34s for a 20x4 fillscreen (MCP23008)
-
 // Write a byte using I2C
-void TextLCD_I2C::_writeByte(int value) {
-  char data[6];
-  
-#if (MCP23008==1)
-  // MCP23008 portexpander
+// The 8 bit databus needs only one Enable strobe: data and E high, followed by E low
+void TextLCD_I2C16::_writeByte(int value) {
+  char data[5];
+  int i = 0;
+
+#if (MCP23017==1)
+  data[i++] = MCP23017_GPIOA;          // set registeraddress
+                                       // Note: auto-increment is disabled, data will go to GPIOA and GPIOB alternately
+#endif
+
+  _setEnableBit(true);                 // set E 
+  _setDataBits(value);                 // set data  
+  data[i++] = _lcd_bus & 0xFF;         // Port A
+  data[i++] = (_lcd_bus >> 8) & 0xFF;  // Port B
+
+  _setEnableBit(false);                // clear E   
+  data[i++] = _lcd_bus & 0xFF;         // Port A
+  data[i++] = (_lcd_bus >> 8) & 0xFF;  // Port B
 
-  data[0] = GPIO;                 // set registeraddres
-                                  // Note: auto-increment is disabled so all data will go to GPIO register
-  
-  _setEnableBit(true);            // set E 
-  _setDataBits(value >> 4);       // set data high  
-  data[1] = _lcd_bus;
-  
-  _setEnableBit(false);           // clear E   
-  data[2] = _lcd_bus;
-  
-  _setEnableBit(true);            // set E   
-  _setDataBits(value);            // set data low    
-  data[3] = _lcd_bus;
-  
-  _setEnableBit(false);           // clear E     
-  data[4] = _lcd_bus;
-  
-  // write the packed data to the I2C portexpander
-  _i2c->write(_slaveAddress, data, 5);    
-#else
-  // PCF8574 of PCF8574A portexpander
-  
-  _setEnableBit(true);            // set E 
-  _setDataBits(value >> 4);       // set data high  
-  data[0] = _lcd_bus;
-  
-  _setEnableBit(false);           // clear E   
-  data[1] = _lcd_bus;
-  
-  _setEnableBit(true);            // set E   
-  _setDataBits(value);            // set data low    
-  data[2] = _lcd_bus;
-  
-  _setEnableBit(false);           // clear E     
-  data[3] = _lcd_bus;
-  
   // write the packed data to the I2C portexpander
-  _i2c->write(_slaveAddress, data, 4);    
-#endif
+  _selectFrequencyI2C(_i2c);
+  _i2c->write(_slaveAddress, data, i);    
 }
 
-#endif /* I2C Expander PCF8574/MCP23008 */
-//---------- End TextLCD_I2C ------------
+#endif /* I2C Expander MCP23017/PCF8575 */
+//---------- End TextLCD_I2C16 ----------
 
 
 //--------- Start TextLCD_SPI -----------
@@ -3508,16 +5807,23 @@ void TextLCD_I2C::_writeByte(int value) {
  /** Create a TextLCD interface using an SPI 74595 portexpander
    *
    * @param spi             SPI Bus
-   * @param cs              chip select pin (active low)
+   * @param cs              chip select pin (active low), NC when the SPI bus has a hardware chip select that latches every frame
    * @param type            Sets the panel size/addressing mode (default = LCD16x2)
    * @param ctrl            LCD controller (default = HD44780)      
+   * @param map             Pin mapping of the expander module (default = NULL, the module selected in TextLCD_Config.h)
    */
-TextLCD_SPI::TextLCD_SPI(SPI *spi, PinName cs, LCDType type, LCDCtrl ctrl) :
+TextLCD_SPI::TextLCD_SPI(SPI *spi, PinName cs, LCDType type, LCDCtrl ctrl, const LCDPinMap *map) :
                          TextLCD_Base(type, ctrl), 
                          _spi(spi),        
                          _cs(cs) {              
+  // Pin mapping and lookup tables
+  _initExpander(&_exp, map, &_pinmap_SPI, _LCD_SPI_NIBBLE, LCD_BYTE_TBL(_LCD_SPI_BYTE));
+
   // Init cs
-  _cs = 1;  
+  _hwcs = (cs == NC);
+  if (!_hwcs) {
+    _cs = 1;  
+  }
 
   // Setup the spi for 8 bit data, low steady state clock,
   // rising edge capture, with a 500KHz or 1MHz clock rate  
@@ -3525,118 +5831,444 @@ TextLCD_SPI::TextLCD_SPI(SPI *spi, PinName cs, LCDType type, LCDCtrl ctrl) :
   _spi->frequency(500000);    
   //_spi.frequency(1000000);    
 
-  wait_ms(100);                   // Wait 100ms to ensure LCD powered up
+#if(LCD_SPI_CHAIN == 1)
+  // Single expander
+  _chain = NULL;
+  _position = 0;
+#endif
+
+  _delay_us(100000);              // Wait 100ms to ensure LCD powered up
   
-  // Init the portexpander bus
-  _lcd_bus = LCD_BUS_SPI_DEF;
+  // Init the portexpander bus, Backlight off
+  _lcd_bus = _exp.map.bl_inv ? _exp.map.bl : 0x00;
   
   // write the new data to the portexpander
-  _cs = 0;  
-  _spi->write(_lcd_bus);   
-  _cs = 1;  
+  _writeBus();
+
+#if(LCD_SPI_BLOCK == 1)
+  _byte_us = 80;      // Bus timing estimate: RS and four Enable strobe frames of 8 bits at 500kHz
+#else
+  _byte_us = 120;     // Bus timing estimate: RS and six Enable strobe frames of 8 bits at 500kHz
+#endif
+
+  _init(_LCD_DL_4);   // Set Datalength to 4 bit for all serial expander interfaces
+}
+
+#if(LCD_SPI_CHAIN == 1)
+ /** Create a TextLCD interface using an SPI 74595 portexpander in a daisy chain
+   *
+   * @param chain           Chain of expanders
+   * @param position        Position of the expander in the chain, 0 is nearest to the mbed
+   * @param type            Sets the panel size/addressing mode (default = LCD16x2)
+   * @param ctrl            LCD controller (default = HD44780)                     
+   * @param map             Pin mapping of the expander module (default = NULL, the module selected in TextLCD_Config.h)
+   */
+TextLCD_SPI::TextLCD_SPI(TextLCD_SPI_Chain *chain, int position, LCDType type, LCDCtrl ctrl, const LCDPinMap *map) :
+                         TextLCD_Base(type, ctrl), 
+                         _spi(chain->_spi),        
+                         _cs(NC) {                 // All bus writes are done by the chain
+  if ((position < 0) || (position >= chain->_nr_lcd)) {
+    error("Error: TextLCD_SPI position outside chain\n\r");
+  }
+  if (chain->_lcd[position] != NULL) {
+    error("Error: TextLCD_SPI position in chain already used\n\r");
+  }
+
+  _chain = chain;
+  _position = position;
+  _chain->_lcd[_position] = this;
+  _hwcs = false;
+
+  // Pin mapping and lookup tables
+  _initExpander(&_exp, map, &_pinmap_SPI, _LCD_SPI_NIBBLE, LCD_BYTE_TBL(_LCD_SPI_BYTE));
+
+  // The chain has waited for power up, init the portexpander bus with Backlight off
+  _lcd_bus = _exp.map.bl_inv ? _exp.map.bl : 0x00;
+  _writeBus();
+
+  _byte_us = 5 * (4 + (16 * chain->_nr_lcd)); // Bus timing estimate: five frames of nr_lcd bytes at 500kHz and CS
 
   _init(_LCD_DL_4);   // Set Datalength to 4 bit for all serial expander interfaces
 }
 
+ /** Create a chain of SPI 74595 portexpanders
+   *
+   * @param spi             SPI Bus
+   * @param cs              chip select pin (active low), latches all expanders
+   * @param nr_lcd          Number of expanders in the chain
+   */
+TextLCD_SPI_Chain::TextLCD_SPI_Chain(SPI *spi, PinName cs, int nr_lcd) :
+                                     _spi(spi),        
+                                     _cs(cs) {
+  // Init cs
+  _cs = 1;  
+
+  // Setup the spi for 8 bit data, low steady state clock,
+  // rising edge capture, with a 500KHz or 1MHz clock rate  
+  _spi->format(8,0);
+  _spi->frequency(500000);    
+
+  _nr_lcd = nr_lcd;
+  _lcd = new TextLCD_SPI*[_nr_lcd];
+  _bus = new char[_nr_lcd];
+  _frames = new char[5 * _nr_lcd];  // Max five bus values for each operation
+  _nr_frames = new int[_nr_lcd];
+
+  TextLCD_Base::_delay_us(100000);  // Wait 100ms to ensure LCD powered up
+
+  // Init the portexpander busses
+  for (int i=0; i<_nr_lcd; i++) {
+    _lcd[i] = NULL;
+    _bus[i] = LCD_BUS_SPI_DEF;
+  }
+  _writeFrames(0);
+}
+
+/** Destruct a chain of SPI 74595 portexpanders
+  *
+  * @param  none
+  * @return none
+  */
+TextLCD_SPI_Chain::~TextLCD_SPI_Chain() {
+  // Detach the displays, they fall back to their own bus writes
+  for (int i=0; i<_nr_lcd; i++) {
+    if (_lcd[i] != NULL) {
+      _lcd[i]->_chain = NULL;
+    }
+  }
+
+  delete[] _lcd;
+  delete[] _bus;
+  delete[] _frames;
+  delete[] _nr_frames;
+}
+
+// Write a new bus value for one expander, the other expanders keep their value
+void TextLCD_SPI_Chain::_write(int position, char value) {
+  _bus[position] = value;
+  _writeFrames(0);
+}
+
+// Write the merged frames, expanders with fewer bus values keep their last value.
+// Without frames the current bus values are written.
+void TextLCD_SPI_Chain::_writeFrames(int nr_frames) {
+  int f = 0;
+
+  do {
+    _cs = 0;  
+    for (int i=_nr_lcd-1; i>=0; i--) {
+      if (f < nr_frames) {
+        if (f < _nr_frames[i]) {
+          _bus[i] = _frames[(f * _nr_lcd) + i];
+        }
+      }
+      _spi->write(_bus[i]);   // Expander nearest to the mbed is sent last
+    }
+    _cs = 1;  
+    f++;
+  } while (f < nr_frames);
+}
+
+/** Write one queued bus operation for each display in step mode that has completed its last instruction
+ *  The strobes of all operations are merged into the same SPI frames. Returns without waiting.
+ *
+ * @param  none
+ * @return Number of pending bus operations for all displays
+ */
+int TextLCD_SPI_Chain::update() {
+  TextLCD_SPI *p;
+  TextLCD_Base::_LCDOp *op;
+  TextLCD_Base::_LCDCtrl_Idx ctrl_idx;
+  int max = 0, pending = 0;
+
+  // Encode the oldest operation of every display that is ready, -1 when not encoded
+  for (int i=0; i<_nr_lcd; i++) {
+    p = _lcd[i];
+    _nr_frames[i] = -1;
+    if ((p != NULL) && (p->_ops_cnt > 0) && !p->_isBusy()) {
+      op = &p->_ops[p->_ops_head];
+      ctrl_idx = p->_ctrl_idx;
+      _nr_frames[i] = p->_encodeOp(op, &_frames[i], _nr_lcd);
+      p->_ctrl_idx = ctrl_idx;  // Restore controller select
+      if (_nr_frames[i] > max) {
+        max = _nr_frames[i];
+      }
+    }
+  }
+
+  // Nothing to shift out when no display is ready
+  if (max > 0) {
+    _writeFrames(max);
+  }
+
+  // Start the execution times of the encoded operations
+  for (int i=0; i<_nr_lcd; i++) {
+    p = _lcd[i];
+    if (_nr_frames[i] >= 0) {
+      op = &p->_ops[p->_ops_head];
+      p->_startBusy(op->wait);          // Execution time of the operation
+      p->_ops_head = (p->_ops_head + 1) % p->_ops_max;
+      p->_ops_cnt--;
+    }
+    if (p != NULL) {
+      pending += p->_ops_cnt;
+    }
+  }
+
+  return pending;
+}
+
+/** Write all queued bus operations of the displays in step mode, merged as in update()
+ *  Waits when all displays are still executing.
+ *
+ * @param  none
+ * @return none
+ */
+void TextLCD_SPI_Chain::flush() {
+  uint32_t remaining, shortest;
+  bool ready;
+
+  while (update() > 0) {
+    // All displays are executing, wait for the first one to complete
+    ready = false;
+    shortest = 0xFFFFFFFF;
+    for (int i=0; i<_nr_lcd; i++) {
+      if ((_lcd[i] != NULL) && (_lcd[i]->_ops_cnt > 0)) {
+        remaining = _lcd[i]->_busyRemaining();
+        if (remaining == 0) {
+          ready = true;
+        }
+        else if (remaining < shortest) {
+          shortest = remaining;
+        }
+      }
+    }
+    if (!ready) {
+      TextLCD_Base::_delay_us(shortest);
+    }
+  }
+}
+#endif
+
+/** Destruct a TextLCD interface using an SPI 74595 portexpander
+  *
+  * @param  none
+  * @return none
+  */ 
+TextLCD_SPI::~TextLCD_SPI() {
+#if(LCD_SPI_CHAIN == 1)
+  if (_chain != NULL) {
+    _chain->_lcd[_position] = NULL;  // Remove from the chain
+  }
+#endif
+  if (_exp.tables != NULL) {delete[] _exp.tables;}  // Lookup tables for a runtime mapping
+}
+
 // Set E pin (or E2 pin)
 // Used for mbed pins, I2C bus expander or SPI shiftregister
 void TextLCD_SPI::_setEnable(bool value) {
 
   if(_ctrl_idx==_LCDCtrl_0) {
     if (value) {
-      _lcd_bus |= LCD_BUS_SPI_E;     // Set E bit 
+      _lcd_bus |= _exp.map.e;     // Set E bit 
     }  
     else {                    
-      _lcd_bus &= ~LCD_BUS_SPI_E;    // Reset E bit                     
+      _lcd_bus &= ~_exp.map.e;    // Reset E bit                     
     }  
   }
   else {
     if (value) {
-      _lcd_bus |= LCD_BUS_SPI_E2;    // Set E2 bit 
+      _lcd_bus |= _exp.map.e2;    // Set E2 bit 
     }  
     else {
-      _lcd_bus &= ~LCD_BUS_SPI_E2;   // Reset E2 bit                     
+      _lcd_bus &= ~_exp.map.e2;   // Reset E2 bit                     
     }  
   }
                   
   // write the new data to the SPI portexpander
-  _cs = 0;  
-  _spi->write(_lcd_bus);   
-  _cs = 1;    
+  _writeBus();
 }    
 
 // Set RS pin
 // Used for mbed pins, I2C bus expander or SPI shiftregister and SPI_N
 void TextLCD_SPI::_setRS(bool value) {
+#if(LCD_SPI_BLOCK == 1)
+  char bus = _lcd_bus;
+#endif
 
   if (value) {
-    _lcd_bus |= LCD_BUS_SPI_RS;    // Set RS bit 
+    _lcd_bus |= _exp.map.rs;    // Set RS bit 
   }  
   else {                    
-    _lcd_bus &= ~LCD_BUS_SPI_RS;   // Reset RS bit                     
+    _lcd_bus &= ~_exp.map.rs;   // Reset RS bit                     
+  }
+
+#if(LCD_SPI_BLOCK == 1)
+  if (_lcd_bus == bus) {
+    return;                        // RS unchanged, saves a frame for each character of a string
   }
+#endif
      
   // write the new data to the SPI portexpander
-  _cs = 0;  
-  _spi->write(_lcd_bus);   
-  _cs = 1;     
+  _writeBus();
 }    
 
 // Set BL pin
 // Used for mbed pins, I2C bus expander or SPI shiftregister
 void TextLCD_SPI::_setBL(bool value) {
 
+  // The Backlight logic of this module differs from the module selected in TextLCD_Config.h
+  if (_exp.map.bl_inv != (BACKLIGHT_INV == 1)) {
+    value = !value;
+  }
+
   if (value) {
-    _lcd_bus |= LCD_BUS_SPI_BL;    // Set BL bit 
+    _lcd_bus |= _exp.map.bl;    // Set BL bit 
   }  
   else {
-    _lcd_bus &= ~LCD_BUS_SPI_BL;   // Reset BL bit                     
+    _lcd_bus &= ~_exp.map.bl;   // Reset BL bit                     
   }
       
   // write the new data to the SPI portexpander
-  _cs = 0;  
-  _spi->write(_lcd_bus);   
-  _cs = 1;      
+  _writeBus();
 }    
 
 // Place the 4bit data on the databus
 // Used for mbed pins, I2C bus expander or SPI shiftregister
 void TextLCD_SPI::_setData(int value) {
 
-  // Set bit by bit to support any mapping of expander portpins to LCD pins
-  if (value & 0x01) {
-    _lcd_bus |= LCD_BUS_SPI_D4;   // Set Databit 
-  }  
-  else {                    
-    _lcd_bus &= ~LCD_BUS_SPI_D4;  // Reset Databit                     
+  _lcd_bus = _mapData(_lcd_bus, value);
+                    
+  // write the new data to the SPI portexpander
+  _writeBus();
+}    
+
+// Map the 4bit data to the expander portpins
+char TextLCD_SPI::_mapData(char bus, int value) {
+
+  // Clear all databits and set the databits from the lookup table, supports any mapping of expander portpins to LCD pins
+  return (bus & ~_exp.d_msk) | _exp.nibble[value & 0x0F];
+}
+
+// Write the bus shadow value to the SPI portexpander
+void TextLCD_SPI::_writeBus() {
+
+#if(LCD_SPI_CHAIN == 1)
+  if (_chain != NULL) {
+    _chain->_write(_position, _lcd_bus);
+    return;
   }
-  
-  if (value & 0x02) {
-    _lcd_bus |= LCD_BUS_SPI_D5;   // Set Databit 
-  }  
-  else {
-    _lcd_bus &= ~LCD_BUS_SPI_D5;  // Reset Databit                     
+#endif
+
+  if (_hwcs) {
+    _spi->write(_lcd_bus);         // Chip select by SPI hardware
+    return;
+  }
+
+  _cs = 0;  
+  _spi->write(_lcd_bus);   
+  _cs = 1;
+}
+
+// Encode a byte as the sequence of expander bus values for the Enable strobes
+// The data nibble is set together with the rising edge of Enable, it is latched on the falling edge
+int TextLCD_SPI::_encodeByte(int value, char *frames, int stride) {
+  char e = (_ctrl_idx == _LCDCtrl_0) ? _exp.map.e : _exp.map.e2;
+  char bus = _lcd_bus & ~(_exp.d_msk | e);
+#if (LCD_BYTE_TABLE == 1)
+  const char *bits = _exp.byte[value & 0xFF];   // Databits for the high and low nibble
+#else
+  const char bits[2] = {_exp.nibble[(value >> 4) & 0x0F], _exp.nibble[value & 0x0F]};
+#endif
+
+  // High nibble
+  frames[0]          = bus | bits[0] | e;
+  frames[stride]     = bus | bits[0];
+
+  // Low nibble
+  frames[2 * stride] = bus | bits[1] | e;
+  frames[3 * stride] = bus | bits[1];
+
+  _lcd_bus = bus | bits[1];
+
+  return 4;
+}
+
+#if(LCD_SPI_BLOCK == 1)
+// Write a byte using SPI
+// The four Enable strobe frames are encoded in one pass, each frame is latched by its own chip select
+void TextLCD_SPI::_writeByte(int value) {
+  char data[4];
+
+#if(LCD_SPI_CHAIN == 1)
+  if (_chain != NULL) {
+    TextLCD_Base::_writeByte(value);   // Other expanders in the chain must keep their bus value
+    return;
+  }
+#endif
+
+  _encodeByte(value, data, 1);
+
+  // write the packed data to the SPI portexpander
+  _writeFrames(data, 4);
+}
+
+// Write a sequence of bus values to the SPI portexpander
+void TextLCD_SPI::_writeFrames(const char *frames, int nr_frames) {
+
+  if (_hwcs) {
+    // Chip select by SPI hardware, each frame is a separate write. Most targets keep the hardware chip select
+    // low during a block write, the 74595 would only latch the last frame.
+    for (int i=0; i<nr_frames; i++) {
+      _spi->write(frames[i]);   
+    }
+    return;
+  }
+
+  for (int i=0; i<nr_frames; i++) {
+    _cs = 0;  
+    _spi->write(frames[i]);   
+    _cs = 1;
+  }
+}
+#endif
+
+#if(LCD_SPI_CHAIN == 1)
+// Encode a captured operation as the sequence of expander bus values written by the 4-bit interface
+// The bus shadow value is updated, the controller select is taken from the operation
+int TextLCD_SPI::_encodeOp(const _LCDOp *op, char *frames, int stride) {
+  char e;
+  int n = 0;
+
+  if (op->flags & _LCDOp_Wait) {
+    return 0;                                    // No bus operation
+  }
+
+  _ctrl_idx = (op->flags & _LCDOp_Ctrl1) ? _LCDCtrl_1 : _LCDCtrl_0;
+  e = (_ctrl_idx == _LCDCtrl_0) ? _exp.map.e : _exp.map.e2;
+
+  // RS
+  if (op->flags & _LCDOp_Data) {
+    _lcd_bus |= _exp.map.rs;
   }
-  
-  if (value & 0x04) {
-    _lcd_bus |= LCD_BUS_SPI_D6;   // Set Databit 
-  }  
   else {
-    _lcd_bus &= ~LCD_BUS_SPI_D6;  // Reset Databit                     
+    _lcd_bus &= ~_exp.map.rs;
+  }
+  frames[stride * n++] = _lcd_bus;
+
+  if (op->flags & _LCDOp_Nibble) {
+    // Nibble on D4..D7
+    _lcd_bus = _mapData(_lcd_bus | e, op->value); frames[stride * n++] = _lcd_bus;
+    _lcd_bus &= ~e;                               frames[stride * n++] = _lcd_bus;
   }
-  
-  if (value & 0x08) {
-    _lcd_bus |= LCD_BUS_SPI_D7;   // Set Databit 
-  }  
   else {
-    _lcd_bus &= ~LCD_BUS_SPI_D7;  // Reset Databit
-  }  
-                    
-  // write the new data to the SPI portexpander
-  _cs = 0;  
-  _spi->write(_lcd_bus);   
-  _cs = 1;       
-}    
+    // High nibble, Low nibble
+    n += _encodeByte(op->value, &frames[stride * n], stride);
+  }
+
+  return n;
+}
+#endif
 
 #endif /* SPI Expander SN74595          */
 //---------- End TextLCD_SPI ------------
@@ -3652,8 +6284,9 @@ void TextLCD_SPI::_setData(int value) {
    * @param type            Sets the panel size/addressing mode (default = LCD16x2)
    * @param bl              Backlight control line (optional, default = NC)     
    * @param ctrl            LCD controller (default = ST7032_3V3)                     
+   * @param frequency       Max I2C clock in Hz (default = 0, the fastest clock supported by the controller and LCD_I2C_MAX_HZ)
    */
-TextLCD_I2C_N::TextLCD_I2C_N(I2C *i2c, char deviceAddress, LCDType type, PinName bl, LCDCtrl ctrl) : 
+TextLCD_I2C_N::TextLCD_I2C_N(I2C *i2c, char deviceAddress, LCDType type, PinName bl, LCDCtrl ctrl, int frequency) : 
                                TextLCD_Base(type, ctrl), 
 
                                _i2c(i2c){
@@ -3661,8 +6294,8 @@ TextLCD_I2C_N::TextLCD_I2C_N(I2C *i2c, char deviceAddress, LCDType type, PinName
   _slaveAddress = deviceAddress & 0xFE;
   
   // Setup the I2C bus
-  // The max bitrate for ST7032i is 400kbit, lets stick to default here
-  _i2c->frequency(100000);
+  // The max bitrate depends on the controller, see _maxFrequency()
+  _setFrequencyI2C(_i2c, _maxFrequencyI2C(frequency, _maxFrequency()), 30);  // Bus timing: address, control and data byte, about 30 bits
 
        
   // The hardware Backlight pin is optional. Test and make sure whether it exists or not to prevent illegal access.
@@ -3688,6 +6321,45 @@ TextLCD_I2C_N::~TextLCD_I2C_N() {
    if (_bl != NULL) {delete _bl;}  // BL pin
 }
 
+/** Find the fastest I2C clock that works for the controller
+  *  Test writes are sent at decreasing clocks, starting at the requested clock, until they are ACKed.
+  *
+  * @param frequency       Max I2C clock in Hz to test (default = 0, the fastest clock supported by the controller and LCD_I2C_MAX_HZ)
+  * @return                Selected I2C clock in Hz, 0 when the controller does not respond
+  */
+int TextLCD_I2C_N::probeFrequency(int frequency) {
+  // Test frame is a single controlbyte for a command (Co=0, RS=0) without data, the controller ignores it
+  const char data[1] = {0x00};
+
+  _busLock();
+  frequency = _probeFrequencyI2C(_i2c, _slaveAddress, _maxFrequencyI2C(frequency, _maxFrequency()), data, 1, 30, (LCD_I2C_ACK == 1));
+  _busUnlock();
+
+  return frequency;
+}
+
+// Max I2C clock in Hz of the controller
+// Older controllers and the PIC on the ACM1602 module only support Standard mode
+int TextLCD_I2C_N::_maxFrequency() {
+
+  switch (_ctrl) {
+    case PCF2113_3V3:
+    case PCF2119_3V3:
+    case PCF2119R_3V3:
+    case SSD1803_3V3:
+    case ST7032_3V3:
+    case ST7032_5V:
+    case SPLC792A_3V3:
+    case ST7036_3V3:
+    case ST7036_5V:
+    case US2066_3V3:
+      return 400000;   // Fast mode
+
+    default:
+      return 100000;   // Standard mode: AC780, AIP31068, PCF2103, PCF2116, ST7066_ACM
+  }
+}
+
 // Not used in this mode
 void TextLCD_I2C_N::_setEnable(bool value) {
 }    
@@ -3737,18 +6409,149 @@ void TextLCD_I2C_N::_writeByte(int value) {
 //
   char data[] = {_controlbyte, value};
     
+  _selectFrequencyI2C(_i2c);
+
+#if(LCD_I2C_ACK==1)
+//Controllers that support ACK
+  _i2c->write(_slaveAddress, data, 2); 
+#else  
+//Controllers that dont support ACK
+//Note: This may be issue with some mbed platforms that dont fully/correctly support I2C byte operations.
+  _i2c->start(); 
+  _i2c->write(_slaveAddress);   
+  _i2c->write(data[0]); 
+  _i2c->write(data[1]);     
+  _i2c->stop();   
+#endif  
+}
+
+#if (LCD_I2C_RUN == 1)
+// Write an optional set address command and a run of data bytes using I2C
+// The command uses a controlbyte with Co=1, so that one more controlbyte (Co=0, RS=1) is followed by all data bytes
+// in a single I2C frame. The I2C clock is lowered for the run when needed, so that each byte takes at least the
+// execution time of the controller.
+void TextLCD_I2C_N::_writeDataRun(int command, const char *data, int len) {
+  int us = _timing.normal;
+  int hz = _i2c_hz;
+#if(LCD_I2C_ACK==1)
+  char frame[3 + 40];   // Command, controlbyte and a chunk of 40 bytes
+  int n, cnt;
+#endif
+
+  if ((_ops != NULL) || ((len + ((command >= 0) ? 1 : 0)) < 2)) {
+    // Captured operations are written one at a time
+    TextLCD_Base::_writeDataRun(command, data, len);
+    return;
+  }
+
+  // Each byte (9 bits) must take at least the execution time
+  if ((us > 0) && (((9 * 1000000) / us) < hz)) {
+    hz = (9 * 1000000) / us;
+  }
+
+  // Wait until the controller has completed the previous instruction
+  _waitBusy();
+
+  _busLock();
+  _selectFrequencyI2C(_i2c);
+
+  if (hz != _i2c_hz) {
+    _i2c->frequency(hz);
+  }
+
 #if(LCD_I2C_ACK==1)
 //Controllers that support ACK
-  _i2c->write(_slaveAddress, data, 2); 
-#else  
+  n = 0;
+  if (command >= 0) {
+    frame[n++] = 0x80;  // Next byte is command, another control byte will follow
+    frame[n++] = command;
+  }
+  frame[n++] = 0x40;    // Next bytes are data, No more control bytes will follow
+
+  do {
+    cnt = (len > 40) ? 40 : len;
+    memcpy(&frame[n], data, cnt);
+    _i2c->write(_slaveAddress, frame, n + cnt); 
+
+    data += cnt;
+    len -= cnt;
+    frame[0] = 0x40;    // Next chunk only needs the data controlbyte
+    n = 1;
+
+    if (len > 0) {
+      _delay_us(us);    // Execution time of the last byte in the chunk
+    }
+  } while (len > 0);
+#else
 //Controllers that dont support ACK
-//Note: This may be issue with some mbed platforms that dont fully/correctly support I2C byte operations.
+//The byte operations ignore the missing ACKs, the frame has only one start, slaveaddress and stop.
   _i2c->start(); 
   _i2c->write(_slaveAddress);   
-  _i2c->write(data[0]); 
-  _i2c->write(data[1]);     
+  if (command >= 0) {
+    _i2c->write(0x80);  // Next byte is command, another control byte will follow
+    _i2c->write(command);
+  }
+  _i2c->write(0x40);    // Next bytes are data, No more control bytes will follow
+  for (int i=0; i<len; i++) {
+    _i2c->write(data[i]);
+  }
   _i2c->stop();   
 #endif  
+
+  if (hz != _i2c_hz) {
+    _i2c->frequency(_i2c_hz);
+  }
+
+  _busUnlock();
+
+  // Execution time of the last byte
+  _wait_us(us);
+}
+
+#if (LCD_PLAN == 1)
+// Overhead of a data run using I2C: slaveaddress and two controlbytes, at the clock used for the run
+int TextLCD_I2C_N::_runCost() {
+  int us = (9 * 1000000) / _i2c_hz;
+
+  return 3 * ((us > _timing.normal) ? us : _timing.normal);
+}
+#endif
+#endif
+
+// Read a byte using I2C
+// The controlbyte selects the busy flag and address counter or data, the controller is read after a repeated start
+int TextLCD_I2C_N::_readByte() {
+#if(LCD_I2C_ACK==1)
+  char data;
+
+  // Many native I2C controllers dont support reading (eg ST7032i, ST7036i)
+  switch (_ctrl) {
+    case PCF2103_3V3:
+    case PCF2113_3V3:
+    case PCF2116_3V3:
+    case PCF2116_5V:
+    case PCF2119_3V3:
+    case PCF2119R_3V3:
+    case SSD1803_3V3:
+    case US2066_3V3:
+      break;
+
+    default:
+      return -1;
+  }
+
+  _selectFrequencyI2C(_i2c);
+  if (_i2c->write(_slaveAddress, &_controlbyte, 1, true) != 0) {
+    return -1;
+  }
+  if (_i2c->read(_slaveAddress, &data, 1) != 0) {
+    return -1;
+  }
+  return (data & 0xFF);
+#else
+  //Controllers that dont support ACK can not be read
+  return -1;
+#endif
 }
 #endif /* Native I2C */
 //-------- End TextLCD_I2C_N ------------
@@ -3764,8 +6567,9 @@ void TextLCD_I2C_N::_writeByte(int value) {
    * @param type            Sets the panel size/addressing mode (default = LCD16x2)
    * @param bl              Backlight control line (optional, default = NC)  
    * @param ctrl            LCD controller (default = ST7032_3V3) 
+   * @param frequency       Max SPI clock in Hz (default = 0, the fastest clock supported by the controller and LCD_SPI_MAX_HZ)
    */       
-TextLCD_SPI_N::TextLCD_SPI_N(SPI *spi, PinName cs, PinName rs, LCDType type, PinName bl, LCDCtrl ctrl) :
+TextLCD_SPI_N::TextLCD_SPI_N(SPI *spi, PinName cs, PinName rs, LCDType type, PinName bl, LCDCtrl ctrl, int frequency) :
                              TextLCD_Base(type, ctrl), 
                              _spi(spi),        
                              _cs(cs),
@@ -3781,10 +6585,9 @@ TextLCD_SPI_N::TextLCD_SPI_N(SPI *spi, PinName cs, PinName rs, LCDType type, Pin
 //  _spi->frequency(1000000);    
   
   // Setup the spi for 8 bit data, low steady state clock,
-  // rising edge capture, with a 500KHz or 1MHz clock rate  
+  // rising edge capture, with the fastest clock rate of the controller
   _spi->format(8,0);
-//  _spi->frequency(500000); 
-  _spi->frequency(1000000);    
+  _setFrequencySPI(_spi, frequency, 8);  // Bus timing: 8 bits
     
   // The hardware Backlight pin is optional. Test and make sure whether it exists or not to prevent illegal access.
   if (bl != NC) {
@@ -3834,11 +6637,76 @@ void TextLCD_SPI_N::_setData(int value) {
 // Write a byte using SPI
 void TextLCD_SPI_N::_writeByte(int value) {
     _cs = 0;
-    wait_us(1);
+    _delay_ns(_cs_setup_ns);  // CS setup
     _spi->write(value);
-    wait_us(1);
+    _delay_ns(_cs_hold_ns);   // CS hold
+    _cs = 1;
+}
+
+#if (LCD_SPI_RUN == 1)
+// Write an optional set address command and a run of data bytes using SPI
+// CS stays low for the whole run, RS is switched between the command and the data. The data is a single block
+// write when the SPI frame of a byte takes longer than the execution time of the controller, otherwise each byte
+// waits for its deadline.
+void TextLCD_SPI_N::_writeDataRun(int command, const char *data, int len) {
+    int us = _timing.normal;
+    uint32_t start;
+
+    if ((_ops != NULL) || ((len + ((command >= 0) ? 1 : 0)) < 2)) {
+      // Captured operations are written one at a time
+      TextLCD_Base::_writeDataRun(command, data, len);
+      return;
+    }
+
+    // Wait until the controller has completed the previous instruction
+    _waitBusy();
+
+    _busLock();
+
+    _cs = 0;
+    _delay_ns(_cs_setup_ns);  // CS setup
+
+    if (command >= 0) {
+      _setRS(false);          // command mode
+      start = us_ticker_read();
+      _spi->write(command);
+      while ((us_ticker_read() - start) < (uint32_t) us) {};
+    }
+
+    _setRS(true);             // data mode
+
+    if (_frame_ns >= (us * 1000)) {
+      // SPI clock is slow enough for the execution time
+      _spi->write(data, len, NULL, 0);
+    }
+    else {
+      for (int i=0; i<len; i++) {
+        start = us_ticker_read();
+        _spi->write(data[i]);
+
+        if (i < (len - 1)) {
+          // Deadline for the next byte
+          while ((us_ticker_read() - start) < (uint32_t) us) {};
+        }
+      }
+    }
+
+    _delay_ns(_cs_hold_ns);   // CS hold
     _cs = 1;
+
+    _busUnlock();
+
+    // Execution time of the last byte
+    _wait_us(us);
 }
+
+#if (LCD_PLAN == 1)
+// Overhead of a data run using SPI: chip select setup and hold
+int TextLCD_SPI_N::_runCost() {
+    return (_cs_setup_ns + _cs_hold_ns + 999) / 1000;
+}
+#endif
+#endif
 #endif /* Native SPI bus     */  
 //-------- End TextLCD_SPI_N ------------
 
@@ -3855,8 +6723,9 @@ void TextLCD_SPI_N::_writeByte(int value) {
    * @param type            Sets the panel size/addressing mode (default = LCD16x2)
    * @param bl              Backlight control line (optional, default = NC)  
    * @param ctrl            LCD controller (default = ST7070) 
+   * @param frequency       Max SPI clock in Hz (default = 0, the fastest clock supported by the controller and LCD_SPI_MAX_HZ)
    */       
-TextLCD_SPI_N_3_8::TextLCD_SPI_N_3_8(SPI *spi, PinName cs, LCDType type, PinName bl, LCDCtrl ctrl) :
+TextLCD_SPI_N_3_8::TextLCD_SPI_N_3_8(SPI *spi, PinName cs, LCDType type, PinName bl, LCDCtrl ctrl, int frequency) :
                                      TextLCD_Base(type, ctrl), 
                                      _spi(spi),        
                                      _cs(cs) {      
@@ -3871,11 +6740,9 @@ TextLCD_SPI_N_3_8::TextLCD_SPI_N_3_8(SPI *spi, PinName cs, LCDType type, PinName
 //  _spi->frequency(1000000);    
 
   // Setup the spi for 8 bit data, low steady state clock,
-  // rising edge capture, with a 500KHz or 1MHz clock rate  
+  // rising edge capture, with the fastest clock rate of the controller
   _spi->format(8,0);
-//  _spi->frequency(500000); 
-  _spi->frequency(1000000);    
-  
+  _setFrequencySPI(_spi, frequency, 8);
   
   // The hardware Backlight pin is optional. Test and make sure whether it exists or not to prevent illegal access.
   if (bl != NC) {
@@ -3887,6 +6754,8 @@ TextLCD_SPI_N_3_8::TextLCD_SPI_N_3_8(SPI *spi, PinName cs, LCDType type, PinName
     _bl = NULL;                 //Construct dummy pin     
   }  
 
+  _byte_us = (4 * _byte_us) + 120;  // Bus timing estimate: data write needs 4 frames of 8 bits and 3 instruction waits
+
   //Sanity check
   if (_ctrl & LCD_C_SPI3_8) { 
     _init(_LCD_DL_8);  // Set Datalength to 8 bit for all native serial interfaces   
@@ -3932,44 +6801,44 @@ void TextLCD_SPI_N_3_8::_writeByte(int value) {
     
   if (_controlbyte == 0x00) { // Byte is command 
     _cs = 0;
-    wait_us(1);
+    _delay_ns(_cs_setup_ns);  // CS setup
     _spi->write(value);
-    wait_us(1);
+    _delay_ns(_cs_hold_ns);   // CS hold
     _cs = 1;
   }  
   else {                      // Byte is data 
     // Select Extended Instr Set
     _cs = 0;
-    wait_us(1);
+    _delay_ns(_cs_setup_ns);  // CS setup
     _spi->write(0x20 | _function | 0x04);   // Set function, 0 0 1 DL N EXT=1 x x (Select Instr Set = 1));
-    wait_us(1);
+    _delay_ns(_cs_hold_ns);   // CS hold
     _cs = 1;     
 
     wait_us(40);                            // Wait until command has finished...    
         
     // Set Count to 1 databyte
     _cs = 0;
-    wait_us(1);    
+    _delay_ns(_cs_setup_ns);  // CS setup    
     _spi->write(0x80);                      // Set display data length, 1 L6 L5 L4 L3 L2 L1 L0 (Instr Set = 1)
-    wait_us(1);
+    _delay_ns(_cs_hold_ns);   // CS hold
     _cs = 1;
 
     wait_us(40);    
                 
     // Write 1 databyte     
     _cs = 0;
-    wait_us(1);    
+    _delay_ns(_cs_setup_ns);  // CS setup    
     _spi->write(value);                     // Write data (Instr Set = 1)
-    wait_us(1);
+    _delay_ns(_cs_hold_ns);   // CS hold
     _cs = 1;         
 
     wait_us(40);    
         
     // Select Standard Instr Set    
     _cs = 0;
-    wait_us(1);    
+    _delay_ns(_cs_setup_ns);  // CS setup    
     _spi->write(0x20 | _function);          // Set function, 0 0 1 DL N EXT=0 x x (Select Instr Set = 0));
-    wait_us(1);
+    _delay_ns(_cs_hold_ns);   // CS hold
     _cs = 1;     
   }  
 }
@@ -3988,8 +6857,9 @@ void TextLCD_SPI_N_3_8::_writeByte(int value) {
    * @param type            Sets the panel size/addressing mode (default = LCD16x2)
    * @param bl              Backlight control line (optional, default = NC)  
    * @param ctrl            LCD controller (default = AIP31068) 
+   * @param frequency       Max SPI clock in Hz (default = 0, the fastest clock supported by the controller and LCD_SPI_MAX_HZ)
    */       
-TextLCD_SPI_N_3_9::TextLCD_SPI_N_3_9(SPI *spi, PinName cs, LCDType type, PinName bl, LCDCtrl ctrl) :
+TextLCD_SPI_N_3_9::TextLCD_SPI_N_3_9(SPI *spi, PinName cs, LCDType type, PinName bl, LCDCtrl ctrl, int frequency) :
                                      TextLCD_Base(type, ctrl), 
                                      _spi(spi),        
                                      _cs(cs) {      
@@ -3998,9 +6868,9 @@ TextLCD_SPI_N_3_9::TextLCD_SPI_N_3_9(SPI *spi, PinName cs, LCDType type, PinName
   _cs = 1;
 
   // Setup the spi for 9 bit data, high steady state clock,
-  // rising edge capture, with a 500KHz or 1MHz clock rate  
+  // rising edge capture, with the fastest clock rate of the controller
   _spi->format(9,3);  
-  _spi->frequency(1000000);    
+  _setFrequencySPI(_spi, frequency, 9);  // Bus timing: 9 bits
   
   // The hardware Backlight pin is optional. Test and make sure whether it exists or not to prevent illegal access.
   if (bl != NC) {
@@ -4061,11 +6931,26 @@ void TextLCD_SPI_N_3_9::_setData(int value) {
 // Write a byte using SPI3 9 bits mode
 void TextLCD_SPI_N_3_9::_writeByte(int value) {
     _cs = 0;
-    wait_us(1);
+    _delay_ns(_cs_setup_ns);  // CS setup
     _spi->write( (_controlbyte << 8) | (value & 0xFF));
-    wait_us(1);
+    _delay_ns(_cs_hold_ns);   // CS hold
     _cs = 1;
 }
+
+#if (LCD_SPI3_PACK == 1)
+// Write an optional set address command and a run of data bytes using SPI3 9 bits mode
+// The words are packed in one bitstream with a single chip select
+void TextLCD_SPI_N_3_9::_writeDataRun(int command, const char *data, int len) {
+    _writeRunSPI3(_spi, &_cs, 9, 3, 9, 0x00, 0x01, command, data, len);  // RS=0, RS=1
+}
+
+#if (LCD_PLAN == 1)
+// Overhead of a data run using SPI: chip select setup and hold
+int TextLCD_SPI_N_3_9::_runCost() {
+    return (_cs_setup_ns + _cs_hold_ns + 999) / 1000;
+}
+#endif
+#endif
 #endif /* Native SPI bus     */  
 //------- End TextLCD_SPI_N_3_9 -----------
 
@@ -4080,8 +6965,9 @@ void TextLCD_SPI_N_3_9::_writeByte(int value) {
    * @param type            Sets the panel size/addressing mode (default = LCD16x2)
    * @param bl              Backlight control line (optional, default = NC)  
    * @param ctrl            LCD controller (default = AIP31068) 
+   * @param frequency       Max SPI clock in Hz (default = 0, the fastest clock supported by the controller and LCD_SPI_MAX_HZ)
    */       
-TextLCD_SPI_N_3_10::TextLCD_SPI_N_3_10(SPI *spi, PinName cs, LCDType type, PinName bl, LCDCtrl ctrl) :
+TextLCD_SPI_N_3_10::TextLCD_SPI_N_3_10(SPI *spi, PinName cs, LCDType type, PinName bl, LCDCtrl ctrl, int frequency) :
                                        TextLCD_Base(type, ctrl), 
                                        _spi(spi),        
                                        _cs(cs) {      
@@ -4090,9 +6976,9 @@ TextLCD_SPI_N_3_10::TextLCD_SPI_N_3_10(SPI *spi, PinName cs, LCDType type, PinNa
   _cs = 1;
 
   // Setup the spi for 10 bit data, low steady state clock,
-  // rising edge capture, with a 500KHz or 1MHz clock rate  
+  // rising edge capture, with the fastest clock rate of the controller
   _spi->format(10,0);
-  _spi->frequency(1000000);    
+  _setFrequencySPI(_spi, frequency, 10);  // Bus timing: 10 bits
   
   // The hardware Backlight pin is optional. Test and make sure whether it exists or not to prevent illegal access.
   if (bl != NC) {
@@ -4154,10 +7040,38 @@ void TextLCD_SPI_N_3_10::_setData(int value) {
 // Write a byte using SPI3 10 bits mode
 void TextLCD_SPI_N_3_10::_writeByte(int value) {
     _cs = 0;
-    wait_us(1);
+    _delay_ns(_cs_setup_ns);  // CS setup
     _spi->write( (_controlbyte << 8) | (value & 0xFF));
-    wait_us(1);
+    _delay_ns(_cs_hold_ns);   // CS hold
+    _cs = 1;
+}
+
+#if (LCD_SPI3_PACK == 1)
+// Write an optional set address command and a run of data bytes using SPI3 10 bits mode
+// The words are packed in one bitstream with a single chip select
+void TextLCD_SPI_N_3_10::_writeDataRun(int command, const char *data, int len) {
+    _writeRunSPI3(_spi, &_cs, 10, 0, 10, 0x00, 0x02, command, data, len);  // RS=0, RS=1
+}
+
+#if (LCD_PLAN == 1)
+// Overhead of a data run using SPI: chip select setup and hold
+int TextLCD_SPI_N_3_10::_runCost() {
+    return (_cs_setup_ns + _cs_hold_ns + 999) / 1000;
+}
+#endif
+#endif
+
+// Read a byte using SPI3 10 bits mode, needs MISO connected to the controller data output
+int TextLCD_SPI_N_3_10::_readByte() {
+    int value;
+
+    _cs = 0;
+    _delay_ns(_cs_setup_ns);  // CS setup
+    value = _spi->write( ((_controlbyte | 0x01) << 8) | 0xFF);  // RW=1
+    _delay_ns(_cs_hold_ns);   // CS hold
     _cs = 1;
+
+    return (value & 0xFF);
 }
 #endif /* Native SPI bus     */  
 //------- End TextLCD_SPI_N_3_10 ----------
@@ -4173,8 +7087,9 @@ void TextLCD_SPI_N_3_10::_writeByte(int value) {
    * @param type            Sets the panel size/addressing mode (default = LCD16x2)
    * @param bl              Backlight control line (optional, default = NC)  
    * @param ctrl            LCD controller (default = PT6314) 
+   * @param frequency       Max SPI clock in Hz (default = 0, the fastest clock supported by the controller and LCD_SPI_MAX_HZ)
    */       
-TextLCD_SPI_N_3_16::TextLCD_SPI_N_3_16(SPI *spi, PinName cs, LCDType type, PinName bl, LCDCtrl ctrl) :
+TextLCD_SPI_N_3_16::TextLCD_SPI_N_3_16(SPI *spi, PinName cs, LCDType type, PinName bl, LCDCtrl ctrl, int frequency) :
                                        TextLCD_Base(type, ctrl), 
                                        _spi(spi),        
                                        _cs(cs) {      
@@ -4183,9 +7098,9 @@ TextLCD_SPI_N_3_16::TextLCD_SPI_N_3_16(SPI *spi, PinName cs, LCDType type, PinNa
   _cs = 1;
 
   // Setup the spi for 8 bit data, low steady state clock,
-  // rising edge capture, with a 500KHz or 1MHz clock rate  
+  // rising edge capture, with the fastest clock rate of the controller
   _spi->format(8,0);
-  _spi->frequency(1000000);    
+  _setFrequencySPI(_spi, frequency, 16);  // Bus timing: 16 bits
   
   // The hardware Backlight pin is optional. Test and make sure whether it exists or not to prevent illegal access.
   if (bl != NC) {
@@ -4248,14 +7163,46 @@ void TextLCD_SPI_N_3_16::_setData(int value) {
 // Write a byte using SPI3 16 bits mode
 void TextLCD_SPI_N_3_16::_writeByte(int value) {
     _cs = 0;
-    wait_us(1);
+    _delay_ns(_cs_setup_ns);  // CS setup
 
     _spi->write(_controlbyte);
 
     _spi->write(value);     
 
-    wait_us(1);
+    _delay_ns(_cs_hold_ns);   // CS hold
+    _cs = 1;
+}
+
+#if (LCD_SPI3_PACK == 1)
+// Write an optional set address command and a run of data bytes using SPI3 16 bits mode
+// The words are packed in one bitstream with a single chip select
+void TextLCD_SPI_N_3_16::_writeDataRun(int command, const char *data, int len) {
+    _writeRunSPI3(_spi, &_cs, 8, 0, 16, 0xF8, 0xFA, command, data, len);  // RS=0, RS=1
+}
+
+#if (LCD_PLAN == 1)
+// Overhead of a data run using SPI: chip select setup and hold
+int TextLCD_SPI_N_3_16::_runCost() {
+    return (_cs_setup_ns + _cs_hold_ns + 999) / 1000;
+}
+#endif
+#endif
+
+// Read a byte using SPI3 16 bits mode, needs MISO connected to the controller data output
+int TextLCD_SPI_N_3_16::_readByte() {
+    int value;
+
+    _cs = 0;
+    _delay_ns(_cs_setup_ns);  // CS setup
+
+    _spi->write(_controlbyte | 0x04);  // RW=1
+
+    value = _spi->write(0x00);     
+
+    _delay_ns(_cs_hold_ns);   // CS hold
     _cs = 1;
+
+    return (value & 0xFF);
 }
 #endif /* Native SPI bus     */  
 //------- End TextLCD_SPI_N_3_16 ----------
@@ -4271,8 +7218,9 @@ void TextLCD_SPI_N_3_16::_writeByte(int value) {
    * @param type            Sets the panel size/addressing mode (default = LCD16x2)
    * @param bl              Backlight control line (optional, default = NC)  
    * @param ctrl            LCD controller (default = SSD1803) 
+   * @param frequency       Max SPI clock in Hz (default = 0, the fastest clock supported by the controller and LCD_SPI_MAX_HZ)
    */       
-TextLCD_SPI_N_3_24::TextLCD_SPI_N_3_24(SPI *spi, PinName cs, LCDType type, PinName bl, LCDCtrl ctrl) :
+TextLCD_SPI_N_3_24::TextLCD_SPI_N_3_24(SPI *spi, PinName cs, LCDType type, PinName bl, LCDCtrl ctrl, int frequency) :
                                        TextLCD_Base(type, ctrl), 
                                        _spi(spi),        
                                        _cs(cs) {      
@@ -4281,9 +7229,9 @@ TextLCD_SPI_N_3_24::TextLCD_SPI_N_3_24(SPI *spi, PinName cs, LCDType type, PinNa
   _cs = 1;
 
   // Setup the spi for 8 bit data, high steady state clock,
-  // rising edge capture, with a 500KHz or 1MHz clock rate  
+  // rising edge capture, with the fastest clock rate of the controller
   _spi->format(8,3);
-  _spi->frequency(1000000);    
+  _setFrequencySPI(_spi, frequency, 24);  // Bus timing: 24 bits
   
   // The hardware Backlight pin is optional. Test and make sure whether it exists or not to prevent illegal access.
   if (bl != NC) {
@@ -4350,7 +7298,7 @@ const uint8_t map3_24[16] = {0x00, 0x80, 0x40, 0xC0, 0x20, 0xA0, 0x60, 0xE0, 0x1
 // Write a byte using SPI3 24 bits mode
 void TextLCD_SPI_N_3_24::_writeByte(int value) {
     _cs = 0;
-    wait_us(1);
+    _delay_ns(_cs_setup_ns);  // CS setup
     _spi->write(_controlbyte);
 
     //Map and send the LSB nibble
@@ -4359,8 +7307,336 @@ void TextLCD_SPI_N_3_24::_writeByte(int value) {
     //Map and send the MSB nibble
     _spi->write( map3_24[(value >> 4) & 0x0F]);     
 
-    wait_us(1);
+    _delay_ns(_cs_hold_ns);   // CS hold
     _cs = 1;
 }
+
+// Read a byte using SPI3 24 bits mode, needs MISO connected to the controller data output
+int TextLCD_SPI_N_3_24::_readByte() {
+    int value;
+
+    _cs = 0;
+    _delay_ns(_cs_setup_ns);  // CS setup
+    _spi->write(_controlbyte | 0x04);  // RW=1
+
+    //Read 8 bits, LSB first
+    value = _spi->write(0x00);     
+
+    _delay_ns(_cs_hold_ns);   // CS hold
+    _cs = 1;
+
+    //Map the bits back to MSB first
+    return (map3_24[value & 0x0F] | (map3_24[(value >> 4) & 0x0F] >> 4));
+}
 #endif /* Native SPI bus     */  
 //------- End TextLCD_SPI_N_3_24 ----------
+
+
+//--------- Start TextLCD_Thread -----------
+#if(LCD_THREAD == 1) /* Thread-safe front end */
+ /** Create a thread-safe front end and start the render thread
+   *
+   * @param lcd         Display, must be initialised
+   * @param queue_size  Max number of queued updates (default = LCD_THREAD_QUEUE)
+   */
+TextLCD_Thread::TextLCD_Thread(TextLCD_Base *lcd, int queue_size) :
+                               _lcd(lcd),
+                               _thread(osPriorityNormal, LCD_THREAD_STACK) {
+
+  _size = _lcd->_nr_cols * _lcd->_nr_rows;
+
+  // Start with the current screen content
+  _frame = new char[_size];
+  _render = new char[_size];
+  if (_lcd->_shadow_ok) {
+    memcpy(_frame, _lcd->_shadow, _size);
+  }
+  else {
+    memset(_frame, ' ', _size);
+  }
+  _dirty = !_lcd->_shadow_ok;
+
+  _queue = new _Cmd[queue_size];
+  _batch = new _Cmd[queue_size];
+  _queue_size = queue_size;
+  _queue_head = 0;
+  _queue_cnt = 0;
+
+  _running = true;
+  _thread.start(callback(this, &TextLCD_Thread::_run));
+  _thread.flags_set(0x01);
+}
+
+/** Destruct the front end, stops the render thread
+  *
+  * @param  none
+  * @return none
+  */
+TextLCD_Thread::~TextLCD_Thread() {
+  _mutex.lock();
+  _running = false;
+  _mutex.unlock();
+
+  _thread.flags_set(0x01);
+  _thread.join();
+
+  delete[] _frame;
+  delete[] _render;
+  delete[] _queue;
+  delete[] _batch;
+}
+
+/** Write text at a screen location
+  * Text continues on the next row and is clipped at the end of the screen.
+  *
+  * @param column  The horizontal position from the left, indexed from 0
+  * @param row     The vertical position from the top, indexed from 0
+  * @param text    Characters to write
+  * @param len     Number of characters, -1 writes up to the terminating 0 (default)
+  * @return        Number of characters written
+  */
+int TextLCD_Thread::write(int column, int row, const char *text, int len) {
+  int pos = (row * _lcd->_nr_cols) + column;
+  int cnt = 0;
+
+  if ((column < 0) || (column >= _lcd->_nr_cols) || (row < 0) || (row >= _lcd->_nr_rows)) {
+    return 0;
+  }
+
+  _mutex.lock();
+  while ((pos < _size) && (cnt != len) && ((len >= 0) || (text[cnt] != 0))) {
+    _frame[pos++] = text[cnt++];
+  }
+  _dirty = true;
+  _mutex.unlock();
+
+  _thread.flags_set(0x01);
+  return cnt;
+}
+
+/** Clear the screen
+  *
+  * @param  none
+  * @return none
+  */
+void TextLCD_Thread::cls() {
+  _mutex.lock();
+  memset(_frame, ' ', _size);
+  _dirty = true;
+  _mutex.unlock();
+
+  _thread.flags_set(0x01);
+}
+
+/** Queue a change of the display mode
+  *
+  * @param displayMode The Display mode (DispOff, DispOn)
+  * @return            false when the queue is full
+  */
+bool TextLCD_Thread::setMode(TextLCD_Base::LCDMode displayMode) {
+  return _post(_Cmd_Mode, displayMode, NULL);
+}
+
+/** Queue a change of the cursor mode
+  *
+  * @param cursorMode  The Cursor mode (CurOff_BlkOff, CurOn_BlkOff, CurOff_BlkOn, CurOn_BlkOn)
+  * @return            false when the queue is full
+  */
+bool TextLCD_Thread::setCursor(TextLCD_Base::LCDCursor cursorMode) {
+  return _post(_Cmd_Cursor, cursorMode, NULL);
+}
+
+/** Queue a change of the backlight
+  *
+  * @param backlightMode The Backlight mode (LightOff, LightOn)
+  * @return              false when the queue is full
+  */
+bool TextLCD_Thread::setBacklight(TextLCD_Base::LCDBacklight backlightMode) {
+  return _post(_Cmd_Backlight, backlightMode, NULL);
+}
+
+/** Queue a User Defined Character pattern
+  *
+  * @param c         The Index of the UDC (0..7) for HD44780 or clones and (0..15) for some more advanced controllers
+  * @param udc_data  The bitpatterns for the UDC (8 bytes of 5 significant bits), copied into the queue
+  * @return          false when the queue is full
+  */
+bool TextLCD_Thread::setUDC(unsigned char c, char *udc_data) {
+  return _post(_Cmd_UDC, c, udc_data);
+}
+
+// Add an update to the queue and wake up the render thread
+bool TextLCD_Thread::_post(int type, int value, const char *data) {
+  _Cmd *cmd;
+
+  _mutex.lock();
+  if (_queue_cnt >= _queue_size) {
+    _mutex.unlock();
+    return false;
+  }
+
+  cmd = &_queue[(_queue_head + _queue_cnt) % _queue_size];
+  cmd->type = type;
+  cmd->value = value;
+  if (data != NULL) {
+    memcpy(cmd->data, data, 8);
+  }
+  _queue_cnt++;
+  _mutex.unlock();
+
+  _thread.flags_set(0x01);
+  return true;
+}
+
+// Render thread, all bus operations for the display are done here
+void TextLCD_Thread::_run() {
+  int cnt;
+  bool dirty;
+
+  while (true) {
+    ThisThread::flags_wait_any(0x01);
+
+    // Take the queued updates and a copy of the frame, producers may continue while the bus is busy
+    _mutex.lock();
+    if (!_running) {
+      _mutex.unlock();
+      return;
+    }
+
+    cnt = _queue_cnt;
+    for (int i=0; i<cnt; i++) {
+      _batch[i] = _queue[(_queue_head + i) % _queue_size];
+    }
+    _queue_head = (_queue_head + cnt) % _queue_size;
+    _queue_cnt = 0;
+
+    dirty = _dirty;
+    if (dirty) {
+      memcpy(_render, _frame, _size);
+      _dirty = false;
+    }
+    _mutex.unlock();
+
+    // Apply the queued updates in order
+    for (int i=0; i<cnt; i++) {
+      switch (_batch[i].type) {
+        case _Cmd_Mode:
+          _lcd->setMode((TextLCD_Base::LCDMode) _batch[i].value);
+          break;
+        case _Cmd_Cursor:
+          _lcd->setCursor((TextLCD_Base::LCDCursor) _batch[i].value);
+          break;
+        case _Cmd_Backlight:
+          _lcd->setBacklight((TextLCD_Base::LCDBacklight) _batch[i].value);
+          break;
+        case _Cmd_UDC:
+          _lcd->setUDC(_batch[i].value, _batch[i].data);
+          break;
+      }
+    }
+
+    // Write the characters that differ from the display
+    if (dirty) {
+      _lcd->_writeCells(0, _render, _size);
+    }
+  }
+}
+#endif /* Thread-safe front end */
+//---------- End TextLCD_Thread ------------
+
+
+//--------- Start TextLCD_Status -----------
+#if(LCD_STATUS == 1) /* ISR-safe status region */
+ /** Create a status region
+   * The region continues on the next row and is clipped at the end of the screen.
+   *
+   * @param lcd     Display
+   * @param column  The horizontal position from the left of the first cell, indexed from 0
+   * @param row     The vertical position from the top of the first cell, indexed from 0
+   * @param len     Number of cells
+   */
+TextLCD_Status::TextLCD_Status(TextLCD_Base *lcd, int column, int row, int len) : _lcd(lcd) {
+  int size = _lcd->_nr_cols * _lcd->_nr_rows;
+
+  _pos = (row * _lcd->_nr_cols) + column;
+  if ((_pos < 0) || (_pos >= size)) {
+    error("Error: TextLCD_Status region outside screen\n\r");
+  }
+  _len = ((_pos + len) > size) ? (size - _pos) : len;
+
+  _cells = new char[_len];
+  _copy = new char[_len];
+  for (int i=0; i<_len; i++) {
+    _cells[i] = ' ';
+  }
+
+  // Write the blank region on the first flush
+  _seq = 1;
+  _flushed = 0;
+}
+
+/** Destruct a status region
+  *
+  * @param  none
+  * @return none
+  */
+TextLCD_Status::~TextLCD_Status() {
+  delete[] _cells;
+  delete[] _copy;
+}
+
+/** Store a character, may be called from interrupt context
+  *
+  * @param idx  Cell index in the region
+  * @param c    Character
+  * @return none
+  */
+void TextLCD_Status::put(int idx, char c) {
+  if ((idx >= 0) && (idx < _len)) {
+    _cells[idx] = c;
+    _seq++;
+  }
+}
+
+/** Store a value as hexadecimal digits, may be called from interrupt context
+  *
+  * @param idx     Cell index in the region of the first digit
+  * @param value   Value
+  * @param digits  Number of digits
+  * @return none
+  */
+void TextLCD_Status::putHex(int idx, uint32_t value, int digits) {
+  static const char hex[] = "0123456789ABCDEF";
+
+  for (int i=(idx + digits - 1); i >= idx; i--) {
+    if ((i >= 0) && (i < _len)) {
+      _cells[i] = hex[value & 0x0F];
+    }
+    value = value >> 4;
+  }
+  _seq++;
+}
+
+/** Write the changed cells to the display, call from the context that owns the display
+  *
+  * @param  none
+  * @return true when the region was written
+  */
+bool TextLCD_Status::flush() {
+  uint32_t seq = _seq;
+
+  if (seq == _flushed) {
+    return false;
+  }
+
+  // Cells stored during the copy are written on the next flush, the sequence counter has changed again
+  for (int i=0; i<_len; i++) {
+    _copy[i] = _cells[i];
+  }
+  _flushed = seq;
+
+  _lcd->_writeCells(_pos, _copy, _len);
+  return true;
+}
+#endif /* ISR-safe status region */
+//---------- End TextLCD_Status ------------
@@ -51,6 +51,11 @@
 #include "TextLCD_Config.h"
 #include "TextLCD_UDC.h"
 
+// Data runs are only collected by the transaction builder
+#if((LCD_SPI_RUN == 1) || (LCD_I2C_RUN == 1) || (LCD_SPI3_PACK == 1)) && (LCD_TX != 1)
+#error "LCD_SPI_RUN, LCD_I2C_RUN and LCD_SPI3_PACK need LCD_TX"
+#endif
+
 /** A TextLCD interface for driving 4-bit HD44780-based LCDs
  *
  * Currently supports 8x1, 8x2, 12x3, 12x4, 16x1, 16x2, 16x3, 16x4, 20x2, 20x4, 24x1, 24x2, 24x4, 40x2 and 40x4 panels.
@@ -71,6 +76,7 @@
  * //TextLCD lcd(p15, p16, p17, p18, p19, p20);                          // RS, E, D4-D7, LCDType=LCD16x2, BL=NC, E2=NC, LCDTCtrl=HD44780
  * //TextLCD_SPI lcd(&spi_lcd, p8, TextLCD::LCD40x4);                    // SPI bus, 74595 expander, CS pin, LCD Type  
  * TextLCD_I2C lcd(&i2c_lcd, 0x42, TextLCD::LCD20x4);                    // I2C bus, PCF8574 Slaveaddress, LCD Type
+ * //TextLCD_I2C16 lcd(&i2c_lcd, MCP23017_SA0, TextLCD::LCD20x4);        // I2C bus, MCP23017 Slaveaddress, LCD Type (8 bit databus)
  * //TextLCD_I2C lcd(&i2c_lcd, 0x42, TextLCD::LCD16x2, TextLCD::WS0010); // I2C bus, PCF8574 Slaveaddress, LCD Type, Device Type (OLED)
  * //TextLCD_SPI_N lcd(&spi_lcd, p8, p9);                                // SPI bus, CS pin, RS pin, LCDType=LCD16x2, BL=NC, LCDTCtrl=ST7032_3V3   
  * //TextLCD_I2C_N lcd(&i2c_lcd, ST7032_SA, TextLCD::LCD16x2, NC, TextLCD::ST7032_3V3);   // I2C bus, Slaveaddress, LCD Type, BL=NC, LCDTCtrl=ST7032_3V3  
@@ -339,6 +345,55 @@ public:
     };
 #endif
 
+   /** LCD instruction execution times in us
+     * All waits after writing to the controller are taken from this table.
+     */
+    typedef struct {
+      int normal;      /**<  Most instructions and data writes to DDRAM */
+      int clear;       /**<  Clear Display and Return Home */
+      int function;    /**<  Function set */
+      int extended;    /**<  Extended instruction set: booster, voltage follower and power control */
+      int cgram;       /**<  Data writes to CGRAM (UDCs) */
+    } LCDTiming;
+
+#if (LCD_I2C == 1) || (LCD_SPI == 1)
+   /** Mapping of the LCD pins to the portpins of an I2C or SPI expander
+     * Each LCD pin is the bitmask of the expander portpin.
+     */
+    typedef struct {
+      char d4, d5, d6, d7;  /**<  Databus */
+      char rs, e, e2;       /**<  Controls, E2 for the second controller of LCD40x4 */
+      char bl, rw;          /**<  Backlight and R/W, RW is kept low */
+      bool mcp23008;        /**<  I2C expander is MCP23008, PCF8574 or PCF8574A otherwise */
+      bool bl_inv;          /**<  Inverted Backlight control */
+    } LCDPinMap;
+#endif
+
+#if (LCD_PINMAP == 1) && ((LCD_I2C == 1) || (LCD_SPI == 1))
+   /** Pin mappings for commercially available expander modules, see TextLCD_Config.h */
+    static const LCDPinMap PinMap_DEFAULT;       /**<  Default (WH), PCF8574/PCF8574A or MCP23008, and 74595 */
+    static const LCDPinMap PinMap_ADAFRUIT;      /**<  Adafruit i2cspilcdbackpack, MCP23008 */
+    static const LCDPinMap PinMap_ADAFRUIT_SPI;  /**<  Adafruit i2cspilcdbackpack, 74595 */
+    static const LCDPinMap PinMap_DFROBOT;       /**<  DFROBOT, PCF8574 */
+    static const LCDPinMap PinMap_LCM1602;       /**<  LCM1602, PCF8574 */
+    static const LCDPinMap PinMap_YWROBOT;       /**<  YWROBOT, PCF8574 */
+    static const LCDPinMap PinMap_fc113;         /**<  FC113, PCF8574 */
+    static const LCDPinMap PinMap_GYLCD;         /**<  GY-LCD, PCF8574 */
+    static const LCDPinMap PinMap_MJKDZ;         /**<  MJKDZ, PCF8574 */
+    static const LCDPinMap PinMap_SYDZ;          /**<  SYDZ, PCF8574A */
+    static const LCDPinMap PinMap_WIDEHK;        /**<  WIDE.HK, MCP23008 */
+    static const LCDPinMap PinMap_LCDPLUG;       /**<  Jeelabs LCD_Plug, MCP23008 */
+#endif
+
+#if (LCD_SHADOW == 1)
+   /** LCD Clear method used by cls() */
+    enum LCDClear {
+        ClearAuto,       /**<  Select fastest method for the bus and screen content (default) */
+        ClearCmd,        /**<  Clear Display instruction */
+        ClearFill        /**<  Overwrite only the non-blank characters with spaces */
+    };
+#endif
+
 #if ((LCD_C_FONT == 1) || (LCD_R_FONT == 1)) //PCF21xxC or PCF21xxR font
    /** Convert ASCII character code to the LCD fonttable code
      *
@@ -395,6 +450,13 @@ public:
     
 #endif    
 
+   /** Destruct a TextLCD_Base interface
+     *
+     * @param  none
+     * @return none
+     */
+    virtual ~TextLCD_Base();
+
     /** Locate cursor to a screen column and row
      *
      * @param column  The horizontal position from the left, indexed from 0
@@ -417,10 +479,28 @@ public:
      */
     void setAddress(int column, int row);        
 
+    /** Initialise the display, includes the power-up delay and cls()
+     *  Needed for displays that were constructed with deferInit() enabled, may also be used to recover a display.
+     *  In step mode the init sequence is queued.
+     */
+    void init();
+
     /** Clear the screen and locate to 0,0
+     *  Note: cls() returns while the controller is still clearing the screen, the next write will wait for completion.
      */
     void cls();
 
+#if(LCD_SHADOW == 1)
+    /** Set the method used by cls()
+     *  ClearFill overwrites only the non-blank characters with spaces, this is faster on partially filled screens
+     *  and slow busses. ClearAuto selects the fastest method for the current bus and screen content.
+     *
+     * @param LCDClear clearMode  The Clear method (ClearAuto, ClearCmd, ClearFill)
+     * @return none
+     */
+    void setClearMode(LCDClear clearMode = ClearAuto);
+#endif
+
     /** Return the number of rows
      *
      * @return  The number of rows
@@ -551,8 +631,142 @@ public:
    void setInvert(bool invertOn);
 #endif
 
+    /** Set the instruction execution times
+      * The default table is selected by the controller type. Calibrated units may use shorter times.
+      * Use deferInit() and initGroup() when the new times should also be used for the init sequence.
+      *
+      * @param const LCDTiming *timing  Execution times in us, NULL restores the defaults for the controller (default)
+      * @return none
+      */
+    void setTiming(const LCDTiming *timing = NULL);
+
+    /** Get the instruction execution times
+      *
+      * @param LCDTiming *timing  Returns the execution times in us
+      * @return none
+      */
+    void getTiming(LCDTiming *timing);
+
+#if(LCD_CALIBRATE == 1)
+    /** Measure the instruction execution times of the attached display and store them in the timing table
+      * The busy flag is polled after Set DDRAM address, Return Home, Function set and a CGRAM data write.
+      * The extended instruction time is not measured. Needs a bus that supports readback
+      * (mbed pins with RW pin, native I2C or native SPI3 with MISO for controllers that support reading).
+      *
+      * @param int margin  Safety margin in percent added to the measured times (default = 25)
+      * @return true when calibrated, false when readback is not supported or the controller did not respond
+      */
+    bool calibrate(int margin = 25);
+#endif
+
+#if(LCD_SLEEP == 1)
+    /** Set the threshold for delays that sleep instead of spin wait
+      * Applies to all displays. Shorter delays remain spin waits.
+      *
+      * @param int threshold  Minimum delay in us that will sleep, 0 disables sleep (default = LCD_SLEEP_US)
+      * @return none
+      */
+    static void setSleep(int threshold = LCD_SLEEP_US);
+#endif
+
+#if(LCD_BUSLOCK == 1)
+    /** Set hooks to share the bus with other devices, eg an RTOS Mutex or I2C::lock() and I2C::unlock()
+      * The bus is locked for each bus operation. update() keeps the bus locked for a chunk of operations
+      * and yields after the max hold time. Otherwise the bus is not locked while waiting for the controller.
+      *
+      * @param lock    Function to acquire the bus, NULL disables locking (default)
+      * @param unlock  Function to release the bus
+      * @param hold    Max time in us that update() holds the bus (default = LCD_BUS_HOLD)
+      * @return none
+      */
+    void setBusLock(void (*lock)(void) = NULL, void (*unlock)(void) = NULL, int hold = LCD_BUS_HOLD);
+#endif
+
+#if(LCD_STEP == 1)
+    /** Enable or disable step mode
+      * In step mode all bus operations are queued and written by step(), methods return without waiting for the bus.
+      * Pending operations are written when step mode is disabled.
+      *
+      * @param bool step  Step mode on (true, default) or off
+      * @return none
+      */
+    void setStepMode(bool step = true);
+
+    /** Write at most one queued bus operation, returns immediately when the controller is still busy
+      * Call from the superloop in step mode.
+      *
+      * @param  none
+      * @return Number of pending bus operations
+      */
+    int step();
+
+    /** Set the time budget for update()
+      * A budget enables step mode, 0 disables step mode and writes the pending operations.
+      *
+      * @param int budget  Max time in us spent in update(), 0 disables step mode
+      * @return none
+      */
+    void setBudget(int budget);
+
+    /** Write queued bus operations until the time budget is used up, waits for the controller within the budget
+      * At least one operation is written when the controller is ready. Call periodically, eg between watchdog kicks.
+      *
+      * @param  none
+      * @return Number of pending bus operations, 0 when all updates are complete
+      */
+    int update();
+#endif
+
+#if(LCD_GROUP == 1)
+    /** Defer the initialisation of all displays that are constructed after this call
+      * Deferred displays must be initialised by initGroup() before they can be used.
+      *
+      * @param bool defer  Defer init (true) or init in the constructor (false, default)
+      * @return none
+      */
+    static void deferInit(bool defer = true);
+
+    /** Initialise a group of displays that were constructed with deferInit() enabled
+      * The init sequences of all displays are interleaved: instructions are written to one display
+      * while the others are still executing. The total init time is close to that of a single display.
+      *
+      * @param TextLCD_Base *lcd[]  Array of pointers to the displays
+      * @param int nr_lcd           Number of displays in the array
+      * @return none
+      */
+    static void initGroup(TextLCD_Base *lcd[], int nr_lcd);
+
+    /** Write queued bus operations for a group of displays in step mode, returns without waiting
+      * Each display that has completed its last instruction writes one operation, so the bus is used
+      * for the other displays while a display is still executing.
+      *
+      * @param TextLCD_Base *lcd[]  Array of pointers to the displays
+      * @param int nr_lcd           Number of displays in the array
+      * @return Number of pending bus operations for all displays
+      */
+    static int stepGroup(TextLCD_Base *lcd[], int nr_lcd);
+
+    /** Write all queued bus operations for a group of displays in step mode
+      * The operations are interleaved as in stepGroup(). Waits when all displays are still executing.
+      *
+      * @param TextLCD_Base *lcd[]  Array of pointers to the displays
+      * @param int nr_lcd           Number of displays in the array
+      * @return none
+      */
+    static void flushGroup(TextLCD_Base *lcd[], int nr_lcd);
+#endif
+
 protected:
 
+#if(LCD_THREAD == 1)
+// The render thread of the thread-safe front end uses the low level methods
+    friend class TextLCD_Thread;
+#endif
+#if(LCD_STATUS == 1)
+// The status region flusher uses the low level methods
+    friend class TextLCD_Status;
+#endif
+
    /** LCD controller select, mainly used for LCD40x4
      */
     enum _LCDCtrl_Idx {
@@ -566,6 +780,32 @@ protected:
         _LCD_DL_8 = 0x10   /**<  Datalength 8 bit */            
     };
 
+   /** Bus operation type and controller select, used for operations that are captured and written at a later time
+     */
+    enum _LCDOpFlags {
+        _LCDOp_Cmd    = 0x00,  /*<  Command byte (RS=0) */
+        _LCDOp_Data   = 0x01,  /*<  Data byte (RS=1) */
+        _LCDOp_Nibble = 0x02,  /*<  MSN only (RS=0), used for 4 bit reset sequence */
+        _LCDOp_Wait   = 0x04,  /*<  No bus operation, wait only */
+        _LCDOp_Ctrl1  = 0x80   /*<  Secondary controller (LCD40x4) */
+    };
+
+   /** Instruction class, selects the execution time from the LCDTiming table
+     */
+    enum _LCDInstr {
+        _LCDInstr_Normal,    /*<  Most instructions */
+        _LCDInstr_Clear,     /*<  Clear Display and Return Home */
+        _LCDInstr_Function   /*<  Function set */
+    };
+
+   /** Captured bus operation
+     */
+    typedef struct {
+      unsigned char  value;    // Command, data or nibble value
+      unsigned char  flags;    // Operation type and controller select (_LCDOpFlags)
+      unsigned short wait;     // Execution time in us before the next operation may start
+    } _LCDOp;
+
     /** Create a TextLCD_Base interface
       * @brief Base class, can not be instantiated
       *
@@ -582,7 +822,13 @@ protected:
   *  @param _LCDDatalength dl sets the datalength of data/commands
   *  @return none
   */
-    void _init(_LCDDatalength dl = _LCD_DL_4);     
+    void _init(_LCDDatalength dl = _LCD_DL_4);
+
+/** Medium level initialisation method for all LCD controllers of the display
+  *  Clear display. The power-up wait is not included.
+  *  @return none
+  */
+    void _initDisplay();
 
 /** Low level initialisation method for LCD controller
   *   Set number of lines, fonttype, no cursor etc
@@ -609,6 +855,43 @@ protected:
   */     
     void _setUDC(unsigned char c, char *udc_data);   
 
+/** Low level character write at the current cursor location, also updates the screen shadow
+  */
+    void _writeChar(int value);
+
+#if(LCD_SHADOW == 1)
+/** Low level method to update characters on the display
+  * Only the characters that differ from the screen shadow are written. The cursor location is restored.
+  * With LCD_PLAN the characters are written in memory address order, so that rows that continue at the next
+  * memory address (eg row 0 and row 2 of LCD_T_A) need no set address. Short gaps of unchanged characters are
+  * rewritten when this is cheaper than a set address on the bus.
+  *
+  * @param int pos            First character location in the screen shadow (row * columns + column)
+  * @param const char *cells  New characters, NULL will write spaces
+  * @param int len            Number of characters
+  * @return                   Number of characters written
+  */
+    int _writeCells(int pos, const char *cells, int len);
+
+#if (LCD_PLAN == 1)
+/** Low level method to split the screen in segments of characters at consecutive memory addresses.
+  * The segments depend only on the LCD type, they are computed once for _writeCells().
+  *  @return none
+  */
+    void _planSegments();
+#endif
+
+/** Low level method to estimate the time to clear the screen using _writeCells()
+  *  @return time in us
+  */
+    int _fillCost();
+#endif
+
+/** Low level method to estimate the time to clear the screen using the Clear Display instruction
+  *  @return time in us
+  */
+    int _clearCost();
+
 /** Low level method to restore the cursortype and display mode for current controller
   */     
     void _setCursorAndDisplayMode(LCDMode displayMode, LCDCursor cursorType);       
@@ -619,14 +902,251 @@ protected:
    
 /** Low level command byte write operation to LCD controller.
   * Methods resets the RS bit and provides the required timing for the command.
+  * The instruction class is derived from the command value.
   */
     void _writeCommand(int command);
+
+/** Low level command byte write operation to LCD controller.
+  * The execution time is selected by the instruction class instead of the command value.
+  */
+    void _writeCommand(int command, _LCDInstr instr);
+
+/** Low level method to test whether a Function set selects an extended instruction set of the controller.
+  * The IS, RE, EXT or H bits depend on the controller.
+  *  @param int command       Function set command
+  *  @return true for an extended instruction set
+  */
+    bool _isExtendedSet(int command);
     
 /** Low level data byte write operation to LCD controller (serial or parallel).
   * Methods sets the RS bit and provides the required timing for the data.
   */   
     void _writeData(int data);
 
+/** Low level write of an optional set address command and a run of data bytes to consecutive memory addresses.
+  * The default writes each byte as a separate bus operation. Interfaces that can write the command and the run
+  * in a single bus transaction override this.
+  *  @param int command       Set address command, -1 for none
+  *  @param const char *data  Data bytes
+  *  @param int len           Number of bytes
+  *  @return none
+  */
+    virtual void _writeDataRun(int command, const char *data, int len);
+
+#if (LCD_PLAN == 1)
+/** Low level method to estimate the overhead of a data run on the bus in addition to its bytes.
+  * This is the cost of ending a run and starting a new one at another address.
+  *  @return time in us, 0 when each byte is a separate bus operation
+  */
+    virtual int _runCost();
+#endif
+
+/** Low level set address operation to LCD controller.
+  * The command is skipped when the controller is already at the address. Otherwise it is merged with the
+  * data writes that follow, it is written immediately when the cursor is visible and no transaction is open.
+  *  @param int addr          DDRAM address
+  *  @return none
+  */
+    void _writeAddress(int addr);
+
+#if (LCD_TX == 1)
+/** Low level methods to open and close a transaction.
+  * Set address and data writes are collected until the transaction is closed. Transactions may be nested.
+  */
+    void _txBegin();
+    void _txEnd();
+
+/** Low level method to write the collected set address command and data bytes.
+  */
+    void _txFlush();
+
+/** Stream lock and unlock, a printf() is a single transaction
+  */
+    virtual void lock();
+    virtual void unlock();
+#endif
+
+/** Low level bus operation (nibble, command or data) to LCD controller.
+  * The operation is captured when _ops is set, otherwise it is written immediately.
+  */
+    void _writeOp(int value, int flags);
+
+/** Low level method to add a bus operation to the captured operations.
+  * The buffer grows when it is full, the oldest operation is written when it is at max size (LCD_STEP_MAX).
+  */
+    void _queueOp(int value, int flags);
+
+/** Low level method to double the size of the captured operations buffer.
+  *  @return true when the buffer was resized, false when it is at max size
+  */
+    bool _growOps();
+
+/** Low level method to write the oldest captured bus operation.
+  * Method waits until the controller has completed the previous instruction.
+  */
+    void _runOp();
+
+/** Low level bus operation (nibble, command or data) to LCD controller.
+  * Method waits until the controller has completed the previous instruction.
+  */
+    void _execOp(int value, int flags);
+
+/** Low level method to write all captured bus operations
+  */
+    void _flushOps();
+
+/** Low level method to write a captured bus operation and start its execution time
+  */
+    void _replayOp(const _LCDOp *op);
+
+/** Low level wait for the execution time of the last instruction.
+  * The wait is not blocking: the next bus operation will wait until the time has elapsed.
+  * The wait is added to the last captured operation when _ops is set, or queued as a wait operation.
+  */
+    void _wait_us(int us);
+    void _wait_ms(int ms);
+
+/** Low level method to start the execution time of the last instruction, also when _ops is set
+  */
+    void _startBusy(int us);
+
+/** Low level wait until the controller has completed the last instruction
+  */
+    void _waitBusy();
+
+/** Low level methods to acquire and release the bus, see setBusLock()
+  */
+    void _busLock();
+    void _busUnlock();
+
+/** Low level test for completion of the last instruction
+  *  @return true while the controller is still busy
+  */
+    bool _isBusy();
+
+/** Low level method to return the remaining execution time of the last instruction
+  *  @return time in us, 0 when the controller is ready
+  */
+    uint32_t _busyRemaining();
+
+/** Low level blocking delay
+  *  Delays of at least the sleep threshold will sleep, shorter delays are spin waits.
+  *  @param uint32_t us  Delay in us
+  *  @return none
+  */
+    static void _delay_us(uint32_t us);
+
+/** Low level short delay for the parallel bus setup and hold times
+  *  Busy loop based on SystemCoreClock, replaces wait_us(1) that takes several us on most targets.
+  *  @param int ns  Delay in ns, the actual delay may be longer
+  *  @return none
+  */
+    static void _delay_ns(int ns);
+
+#if (LCD_SPI_N == 1) || (LCD_SPI_N_3_8 == 1) || (LCD_SPI_N_3_9 == 1) || (LCD_SPI_N_3_10 == 1) || (LCD_SPI_N_3_16 == 1) || (LCD_SPI_N_3_24 == 1)
+#if (LCD_SPI3_PACK == 1) && ((LCD_SPI_N_3_9 == 1) || (LCD_SPI_N_3_10 == 1) || (LCD_SPI_N_3_16 == 1))
+/** Low level write of an optional command and a run of data bytes as one packed SPI3 bitstream
+  *  Each byte is a word of the control bits and the data, the words are packed MSB first into a single block write.
+  *  @param SPI *spi         SPI bus
+  *  @param DigitalOut *cs   Chip select pin (active low)
+  *  @param int format       SPI frame width used by the interface
+  *  @param int mode         SPI mode
+  *  @param int bits         Number of bits in a word (9, 10 or 16)
+  *  @param int control_cmd  Control bits for a command (RS=0) placed above the command byte
+  *  @param int control      Control bits for data (RS=1) placed above the data byte
+  *  @param int command      Set address command, -1 for none
+  *  @param const char *data Data bytes
+  *  @param int len          Number of bytes
+  *  @return none
+  */
+    void _writeRunSPI3(SPI *spi, DigitalOut *cs, int format, int mode, int bits, int control_cmd, int control, int command, const char *data, int len);
+#endif
+
+/** Low level method to set the SPI clock and the chip select timing of the native SPI controller
+  *  The clock is limited to the max of the controller and to LCD_SPI_MAX_HZ for the board.
+  *  @param SPI *spi       SPI bus
+  *  @param int frequency  Requested SPI clock in Hz, 0 selects the fastest clock supported by the controller
+  *  @param int bits       Number of SPI bits to write one byte to the LCD
+  *  @return none
+  */
+    void _setFrequencySPI(SPI *spi, int frequency, int bits);
+#endif
+
+#if (LCD_I2C == 1) || (LCD_I2C16 == 1) || (LCD_I2C_N == 1)
+/** Low level method to select the I2C clock
+  *  The clock is limited to the max of the expander or controller and to LCD_I2C_MAX_HZ for the board.
+  *  @param int frequency  Requested I2C clock in Hz, 0 selects the fastest supported clock
+  *  @param int max        Max I2C clock in Hz of the expander or controller
+  *  @return int           Selected I2C clock in Hz
+  */
+    static int _maxFrequencyI2C(int frequency, int max);
+
+/** Low level method to set the I2C clock and the bus timing estimate
+  *  @param I2C *i2c       I2C bus
+  *  @param int frequency  I2C clock in Hz
+  *  @param int bits       Number of I2C bits to write one byte to the LCD
+  *  @return none
+  */
+    void _setFrequencyI2C(I2C *i2c, int frequency, int bits);
+
+/** Low level method to restore the I2C clock of this display before a bus transaction
+  *  Displays on a shared I2C bus may use different clocks (eg PCF8574 and MCP23008 modules). The clock is only
+  *  written when another display has changed it since the last transaction. Clock changes by other devices on
+  *  the bus are not tracked.
+  *  @param I2C *i2c       I2C bus
+  *  @return none
+  */
+    void _selectFrequencyI2C(I2C *i2c);
+
+/** Low level method to find the fastest I2C clock that is ACKed by the device
+  *  The test frame is written at decreasing standard clocks until it is ACKed LCD_I2C_PROBE times in a row.
+  *  @param I2C *i2c         I2C bus
+  *  @param char address     I2C slave address
+  *  @param int frequency    Fastest I2C clock in Hz to test
+  *  @param const char *data Test frame, it must not change the state of the LCD
+  *  @param int length       Length of the test frame
+  *  @param int bits         Number of I2C bits to write one byte to the LCD
+  *  @param bool ack         Device ACKs its slave address, the first clock is selected when false
+  *  @return int             Selected I2C clock in Hz, 0 when the device did not ACK at 100kHz
+  */
+    int _probeFrequencyI2C(I2C *i2c, char address, int frequency, const char *data, int length, int bits, bool ack);
+#endif
+
+#if (LCD_I2C == 1) || (LCD_SPI == 1)
+/** Expander pin mapping with its lookup tables
+  */
+    typedef struct {
+      LCDPinMap map;
+      char d_msk;               // Databus mask
+      const char *nibble;       // Databits for a nibble, 16 entries
+#if (LCD_BYTE_TABLE == 1)
+      const char (*byte)[2];    // Databits for the high and low nibble of a byte, 256 entries
+#endif
+      char *tables;             // Lookup tables computed for a runtime mapping, NULL for the mapping selected in TextLCD_Config.h
+    } _LCDExpander;
+
+/** Low level method to init the expander pin mapping
+  *  @param _LCDExpander *exp        Expander pin mapping to init
+  *  @param const LCDPinMap *map     Runtime mapping, NULL selects the default mapping and tables
+  *  @param const LCDPinMap *def     Default mapping, selected in TextLCD_Config.h
+  *  @param const char *nibble       Default nibble table
+  *  @param const char (*byte)[2]    Default byte table, NULL without LCD_BYTE_TABLE
+  *  @return none
+  */
+    static void _initExpander(_LCDExpander *exp, const LCDPinMap *map, const LCDPinMap *def, const char *nibble, const char (*byte)[2]);
+#endif
+
+#if(LCD_CALIBRATE == 1)
+/** Low level method to measure the execution time of an instruction by polling the busy flag
+  *  @param int value    Command or data byte
+  *  @param int flags    Operation type (_LCDOpFlags)
+  *  @param int current  Current execution time, used when the time is below the resolution of the readback,
+  *                      -1 when the instruction must be seen busy to verify the readback
+  *  @return time in us, -1 when the controller did not respond
+  */
+    int _measureOp(int value, int flags, int current);
+#endif
+
 /** Pure Virtual Low level writes to LCD Bus (serial or parallel)
   * Set the Enable pin.
   */
@@ -652,6 +1172,12 @@ protected:
   */
     virtual void _writeByte(int value);
 
+/** Low level byte read operation from LCD controller (serial or parallel)
+  * Depending on the RS pin this byte will be the busy flag and address counter or data
+  * @return byte value, -1 when the bus does not support readback
+  */
+    virtual int _readByte();
+
 //Display type
     LCDType _type;      // Display type 
     int _nr_cols;       
@@ -678,7 +1204,97 @@ protected:
 
 // Icon, Booster mode and contrast saved to allow contrast change at later time
 // Only available for controllers with added features
-    int _icon_power, _contrast;          
+    int _icon_power, _contrast;
+
+// Datalength saved to allow deferred init
+    _LCDDatalength _dl;
+
+// Datalength of the parallel bus to the controller, 8 bit for 16 bit expanders
+    _LCDDatalength _bus_dl;
+
+#if(LCD_GROUP == 1)
+// Skip init in constructor, see deferInit()
+    static bool _init_defer;
+#endif
+
+#if(LCD_SLEEP == 1)
+// Minimum delay in us that will sleep, see setSleep()
+    static int _sleep_threshold;
+#endif
+
+// Execution time of the last instruction, the next bus operation waits until it has elapsed
+    uint32_t _busy_start;  // Timestamp in us
+    uint32_t _busy_time;   // Execution time in us
+
+// Instruction execution times in us
+    LCDTiming _timing;
+    bool _cgram;        // Data writes go to CGRAM, selects the CGRAM write time
+    bool _ext_set;      // Extended instruction set is selected, 0x40-0x7F are not Set CGRAM address
+
+#if (LCD_TX == 1)
+// Transaction of a set address command and a run of data bytes
+    int _tx_level;      // Nesting of _txBegin()
+    int _tx_cmd;        // Deferred set address command, -1 for none
+    char _tx_data[40];  // Data run
+    int _tx_len;
+    int _ac;            // Address counter of the controller after the collected operations, -1 when unknown
+#endif
+
+// Captured bus operations, written at a later time (eg interleaved init of multiple displays, step mode)
+// Ringbuffer, _ops_head is the oldest operation
+    _LCDOp *_ops;
+    int _ops_head, _ops_cnt, _ops_max;
+
+#if(LCD_STEP == 1)
+// Max time in us spent in update()
+    int _budget;
+#endif
+
+#if(LCD_BUSLOCK == 1)
+// Hooks to share the bus with other devices
+    void (*_lock)(void);
+    void (*_unlock)(void);
+    int _hold_max;          // Max time in us to hold the bus in update()
+    bool _hold;             // Bus is held for a chunk of operations
+    uint32_t _hold_start;   // Timestamp in us
+#endif
+
+// Estimated time in us to write a command or data byte on the bus, used to select the fastest update method
+    int _byte_us;
+
+#if (LCD_I2C == 1) || (LCD_I2C16 == 1) || (LCD_I2C_N == 1)
+// I2C clock
+    int _i2c_hz;
+
+// Last I2C bus and clock set by a display
+    static I2C *_i2c_bus;
+    static int _i2c_bus_hz;
+#endif
+
+#if (LCD_SPI_N == 1) || (LCD_SPI_N_3_8 == 1) || (LCD_SPI_N_3_9 == 1) || (LCD_SPI_N_3_10 == 1) || (LCD_SPI_N_3_16 == 1) || (LCD_SPI_N_3_24 == 1)
+// Chip select timing of the native SPI controller in ns
+    int _cs_setup_ns;   // CS low to first clock
+    int _cs_hold_ns;    // Last clock to CS high
+    int _frame_ns;      // Duration of the SPI frame for one byte
+    int _spi_hz;        // SPI clock
+#endif
+
+#if(LCD_SHADOW == 1)
+// Screen shadow, copy of the characters on the display
+    char *_shadow;
+    bool _shadow_ok;    // Shadow is valid after the first cls()
+    LCDClear _clear;    // Method used by cls()
+
+#if (LCD_PLAN == 1)
+// Screen segments, at most two for each row (LCD_T_C, LCD_T_F)
+    int _nr_seg;
+    int _seg_pos[8];    // First character location in the screen shadow
+    int _seg_len[8];    // Number of characters
+    int _seg_adr[8];    // Memory address of the first character
+    int _seg_nxt[8];    // Segment that continues at the next memory address, -1 for none
+    bool _seg_head[8];  // Segment does not continue another segment
+#endif
+#endif
 };
 
 //--------- End TextLCD_Base -----------
@@ -700,8 +1316,56 @@ public:
      * @param bl    Backlight control line (optional, default = NC)      
      * @param e2    Enable2 line (clock for second controller, LCD40x4 only)  
      * @param ctrl  LCD controller (default = HD44780)           
+     * @param rw    Read/write line (optional, default = NC, RW must be tied to GND)  
+     */
+    TextLCD(PinName rs, PinName e, PinName d4, PinName d5, PinName d6, PinName d7, LCDType type = LCD16x2, PinName bl = NC, PinName e2 = NC, LCDCtrl ctrl = HD44780, PinName rw = NC);
+
+#if (LCD_BUS8 == 1)
+    /** Create a TextLCD interface for using regular mbed pins with an 8 bit databus
+     *
+     * @param rs    Instruction/data control line
+     * @param e     Enable line (clock)
+     * @param d0-d7 Data lines for using as an 8-bit interface
+     * @param type  Sets the panel size/addressing mode (default = LCD16x2)
+     * @param bl    Backlight control line (optional, default = NC)      
+     * @param e2    Enable2 line (clock for second controller, LCD40x4 only)  
+     * @param ctrl  LCD controller (default = HD44780)           
+     * @param rw    Read/write line (optional, default = NC, RW must be tied to GND)  
+     */
+    TextLCD(PinName rs, PinName e, PinName d0, PinName d1, PinName d2, PinName d3, PinName d4, PinName d5, PinName d6, PinName d7, LCDType type = LCD16x2, PinName bl = NC, PinName e2 = NC, LCDCtrl ctrl = HD44780, PinName rw = NC);
+
+#if DEVICE_PORTOUT
+    /** Create a TextLCD interface for using regular mbed pins with an 8 bit databus on contiguous pins of a port
+     *  The databus is written with a single PortOut access.
+     *
+     * @param rs    Instruction/data control line
+     * @param e     Enable line (clock)
+     * @param port  Port for the data lines
+     * @param d0    Bit number of data line D0 in the port, D1..D7 use the next bits
+     * @param type  Sets the panel size/addressing mode (default = LCD16x2)
+     * @param bl    Backlight control line (optional, default = NC)      
+     * @param e2    Enable2 line (clock for second controller, LCD40x4 only)  
+     * @param ctrl  LCD controller (default = HD44780)           
+     */
+    TextLCD(PinName rs, PinName e, PortName port, int d0, LCDType type = LCD16x2, PinName bl = NC, PinName e2 = NC, LCDCtrl ctrl = HD44780);
+#endif
+#endif
+
+#if (LCD_PORT == 1) && DEVICE_PORTOUT
+    /** Create a TextLCD interface for using regular mbed pins with the databus, RS and E on one port
+     *  RS, E and the 4 bit databus are updated with one PortOut access, a nibble needs two port writes.
+     *
+     * @param port  Port for the data and control lines
+     * @param rs    Bit number of RS in the port
+     * @param e     Bit number of E in the port
+     * @param d4    Bit number of data line D4 in the port, D5..D7 use the next bits
+     * @param type  Sets the panel size/addressing mode (default = LCD16x2)
+     * @param bl    Backlight control line (optional, default = NC)      
+     * @param e2    Enable2 line (clock for second controller, LCD40x4 only)  
+     * @param ctrl  LCD controller (default = HD44780)           
      */
-    TextLCD(PinName rs, PinName e, PinName d4, PinName d5, PinName d6, PinName d7, LCDType type = LCD16x2, PinName bl = NC, PinName e2 = NC, LCDCtrl ctrl = HD44780);
+    TextLCD(PortName port, int rs, int e, int d4, LCDType type = LCD16x2, PinName bl = NC, PinName e2 = NC, LCDCtrl ctrl = HD44780);
+#endif
 
    /** Destruct a TextLCD interface for using regular mbed pins
      *
@@ -732,15 +1396,48 @@ private:
   */   
     virtual void _setData(int value);
 
+/** Implementation of Low level reads from LCD Bus (parallel)
+  * Read a byte in 4 bit or 8 bit mode, needs the RW pin.
+  */   
+    virtual int _readByte();
+
+/** Init the optional Hardware pins
+  */   
+    void _initPins(PinName bl, PinName e2, PinName rw);
+
+/** Low level writes to LCD Bus (parallel)
+  * Write a byte using one Enable strobe in 8 bit mode, two Enable strobes in 4 bit mode.
+  */
+    virtual void _writeByte(int value);   
+
+#if (LCD_BUS8 == 1)
+/** Low level writes to LCD Bus (parallel)
+  * Set the databus value (8 bit).
+  */   
+    void _setData8(int value);
+#endif
+
 /** Regular mbed pins bus
   */
     DigitalOut _rs, _e;
-    BusOut _d;
+    BusInOut _d;
     
-/** Optional Hardware pins for the Backlight and LCD40x4 device
+/** Optional Hardware pins for the Backlight, LCD40x4 device and readback
   * Default PinName value is NC, must be used as pointer to avoid issues with mbed lib and DigitalOut pins
   */
-    DigitalOut *_bl, *_e2;                                                                                                                                                                                                                                                     
+    DigitalOut *_bl, *_e2, *_rw;                                                                                                                                                                                                                                                     
+
+#if DEVICE_PORTOUT
+/** Optional Port for the databus on contiguous pins, NULL when the databus uses BusInOut
+  * RS and E may use the same port, the masks are 0 when they use DigitalOut
+  */
+    PortOut *_port;
+    int _port_shift;
+    int _port_rs, _port_e;
+
+// Port shadow value
+    int _port_bus;
+#endif
 };
 
 //----------- End TextLCD ---------------
@@ -760,8 +1457,25 @@ public:
      * @param deviceAddress   I2C slave address (PCF8574 (or PCF8574A) or MCP23008 portexpander, default = PCF8574_SA0 = 0x40)
      * @param type            Sets the panel size/addressing mode (default = LCD16x2)
      * @param ctrl            LCD controller (default = HD44780)                
+     * @param map             Pin mapping of the expander module (default = NULL, the module selected in TextLCD_Config.h)
+     * @param frequency       Max I2C clock in Hz (default = 0, the fastest clock supported by the expander and LCD_I2C_MAX_HZ)
+     */
+    TextLCD_I2C(I2C *i2c, char deviceAddress = PCF8574_SA0, LCDType type = LCD16x2, LCDCtrl ctrl = HD44780, const LCDPinMap *map = NULL, int frequency = 0);
+
+   /** Destruct a TextLCD interface using an I2C PCF8574 (or PCF8574A) or MCP23008 portexpander
+     *
+     * @param  none
+     * @return none
+     */ 
+    virtual ~TextLCD_I2C();
+
+   /** Find the fastest I2C clock that works for the portexpander
+     *  Test writes are sent at decreasing clocks, starting at the requested clock, until they are ACKed.
+     *
+     * @param frequency       Max I2C clock in Hz to test (default = 0, the fastest clock supported by the expander and LCD_I2C_MAX_HZ)
+     * @return                Selected I2C clock in Hz, 0 when the portexpander does not respond
      */
-    TextLCD_I2C(I2C *i2c, char deviceAddress = PCF8574_SA0, LCDType type = LCD16x2, LCDCtrl ctrl = HD44780);
+    int probeFrequency(int frequency = 0);
 
 private:
     
@@ -807,28 +1521,223 @@ private:
   */
     virtual void _writeByte(int value);   
 
+/** Place the four Enable strobe frames of a byte in a buffer
+  *  @param char *frames  Buffer for the frames
+  *  @param int n         Index of the first frame
+  *  @param int value     Byte to write
+  *  @return int          Index after the last frame
+  */
+    int _encodeByte(char *frames, int n, int value);
+
+#if (LCD_TX == 1)
+/** Low level write of an optional set address command and a run of data bytes (serial expander)
+  * The strobe frames of all bytes are concatenated in the same I2C write.
+  */
+    virtual void _writeDataRun(int command, const char *data, int len);
+#endif
+
+#if (LCD_PLAN == 1)
+/** Overhead of a data run on the bus
+  */
+    virtual int _runCost();
+#endif
+
 /** Write data to MCP23008 I2C portexpander
   *  @param reg register to write
   *  @param value data to write
   *  @return none     
   */
     void _writeRegister (int reg, int value);     
-  
+
+/** Write the databus shadowvalue to the portexpander
+  */
+    void _writeBus();
+  
 //I2C bus
     I2C *_i2c;
     char _slaveAddress;
     
 // Internal bus shadow value for serial bus only
     char _lcd_bus;      
+
+// Expander pin mapping
+    _LCDExpander _exp;
 };
 #endif /* I2C Expander PCF8574/MCP23008 */
 
 //---------- End TextLCD_I2C ------------
 
 
+//--------- Start TextLCD_I2C16 ---------
+#if(LCD_I2C16 == 1) /* I2C Expander MCP23017/PCF8575 */
+
+/** Create a TextLCD interface using an I2C MCP23017 or PCF8575 16 bit portexpander
+  *  The LCD uses an 8 bit databus, each byte needs one Enable strobe.
+  */
+class TextLCD_I2C16 : public TextLCD_Base {    
+public:
+   /** Create a TextLCD interface using an I2C MCP23017 or PCF8575 16 bit portexpander
+     *
+     * @param i2c             I2C Bus
+     * @param deviceAddress   I2C slave address (MCP23017 or PCF8575 portexpander, default = MCP23017_SA0 = 0x40)
+     * @param type            Sets the panel size/addressing mode (default = LCD16x2)
+     * @param ctrl            LCD controller (default = HD44780)                
+     * @param frequency       Max I2C clock in Hz (default = 0, the fastest clock supported by the expander and LCD_I2C_MAX_HZ)
+     */
+    TextLCD_I2C16(I2C *i2c, char deviceAddress = MCP23017_SA0, LCDType type = LCD16x2, LCDCtrl ctrl = HD44780, int frequency = 0);
+
+   /** Find the fastest I2C clock that works for the portexpander
+     *  Test writes are sent at decreasing clocks, starting at the requested clock, until they are ACKed.
+     *
+     * @param frequency       Max I2C clock in Hz to test (default = 0, the fastest clock supported by the expander and LCD_I2C_MAX_HZ)
+     * @return                Selected I2C clock in Hz, 0 when the portexpander does not respond
+     */
+    int probeFrequency(int frequency = 0);
+
+private:
+    
+/** Place the Enable bit in the databus shadowvalue
+  *  Used for mbed I2C portexpander
+  *  @param value data to write
+  *  @return none
+  */
+    void _setEnableBit(bool value);    
+
+/** Implementation of pure Virtual Low level writes to LCD Bus (serial expander)
+  * Set the Enable pin.
+  */
+    virtual void _setEnable(bool value);
+
+/** Implementation of pure Virtual Low level writes to LCD Bus (serial expander)
+  * Set the RS pin (0 = Command, 1 = Data).
+  */   
+    virtual void _setRS(bool value);  
+
+/** Implementation of pure Virtual Low level writes to LCD Bus (serial expander)
+  * Set the BL pin (0 = Backlight Off, 1 = Backlight On).
+  */   
+    virtual void _setBL(bool value);
+    
+/** Place the 8bit data in the databus shadowvalue
+  *  Used for mbed I2C portexpander
+  *  @param value data to write
+  *  @return none
+  */
+    void _setDataBits(int value);
+
+/** Implementation of pure Virtual Low level writes to LCD Bus (serial expander)
+  * Set the databus value (4 bit on D4..D7).
+  */   
+    virtual void _setData(int value);
+
+/** Low level writes to LCD serial bus expander
+  * Write a byte using a single Enable strobe.
+  */
+    virtual void _writeByte(int value);   
+
+/** Write the databus shadowvalue to the portexpander
+  */
+    void _writeBus();
+
+/** Write data to MCP23017 I2C portexpander
+  *  @param reg register to write
+  *  @param value data to write
+  *  @return none     
+  */
+    void _writeRegister (int reg, int value);     
+  
+//I2C bus
+    I2C *_i2c;
+    char _slaveAddress;
+    
+// Internal bus shadow value for serial bus only
+    int _lcd_bus;      
+};
+#endif /* I2C Expander MCP23017/PCF8575 */
+
+//---------- End TextLCD_I2C16 ----------
+
+
 //--------- Start TextLCD_SPI -----------
 #if(LCD_SPI == 1) /* SPI Expander SN74595          */
 
+#if(LCD_SPI_CHAIN == 1)
+class TextLCD_SPI;
+
+/** Daisy-chained SPI 74595 portexpanders that share one chip select (latch) pin, each expander drives a display
+  * Every SPI frame holds one byte for each expander, the byte for the expander nearest to the mbed is sent last.
+  * Displays in step mode are updated together by update() or flush(): the bus strobes of one queued operation
+  * for each display are merged into the same frames, so N displays are written in about the time of one.
+  *
+  * Example:
+  * @code
+  * SPI spi_lcd(p5, NC, p7);                                      // MOSI, MISO, SCLK
+  * TextLCD_SPI_Chain chain(&spi_lcd, p8, 2);                     // SPI bus, CS pin, Number of expanders
+  * TextLCD_SPI lcd0(&chain, 0, TextLCD::LCD20x4);                // Chain, Position, LCD Type
+  * TextLCD_SPI lcd1(&chain, 1, TextLCD::LCD20x4);
+  *
+  * lcd0.setStepMode(); lcd1.setStepMode();
+  * lcd0.printf("Display 0"); lcd1.printf("Display 1");
+  * chain.flush();                                                // Merged update of both displays
+  * @endcode
+  */
+class TextLCD_SPI_Chain {
+public:
+    /** Create a chain of SPI 74595 portexpanders
+     *
+     * @param spi             SPI Bus
+     * @param cs              chip select pin (active low), latches all expanders
+     * @param nr_lcd          Number of expanders in the chain
+     */
+    TextLCD_SPI_Chain(SPI *spi, PinName cs, int nr_lcd);
+
+   /** Destruct a chain of SPI 74595 portexpanders
+     *
+     * @param  none
+     * @return none
+     */
+    virtual ~TextLCD_SPI_Chain();
+
+    /** Write one queued bus operation for each display in step mode that has completed its last instruction
+     *  The strobes of all operations are merged into the same SPI frames. Returns without waiting.
+     *
+     * @param  none
+     * @return Number of pending bus operations for all displays
+     */
+    int update();
+
+    /** Write all queued bus operations of the displays in step mode, merged as in update()
+     *  Waits when all displays are still executing.
+     *
+     * @param  none
+     * @return none
+     */
+    void flush();
+
+protected:
+    friend class TextLCD_SPI;
+
+/** Write a new bus value for one expander, the other expanders keep their value
+  */
+    void _write(int position, char value);
+
+/** Write the merged frames
+  */
+    void _writeFrames(int nr_frames);
+
+// SPI bus        
+    SPI *_spi;
+    DigitalOut _cs;    
+
+// Displays in the chain, the current bus value for each expander, merged frames and number of frames for each expander
+    int _nr_lcd;
+    TextLCD_SPI **_lcd;
+    char *_bus;
+    char *_frames;
+    int *_nr_frames;
+};
+#endif
+
 /** Create a TextLCD interface using an SPI 74595 portexpander
   *
   */
@@ -837,13 +1746,36 @@ public:
     /** Create a TextLCD interface using an SPI 74595 portexpander
      *
      * @param spi             SPI Bus
-     * @param cs              chip select pin (active low)
+     * @param cs              chip select pin (active low), NC when the SPI bus has a hardware chip select that latches every frame
      * @param type            Sets the panel size/addressing mode (default = LCD16x2)
      * @param ctrl            LCD controller (default = HD44780)                     
+     * @param map             Pin mapping of the expander module (default = NULL, the module selected in TextLCD_Config.h)
      */
-    TextLCD_SPI(SPI *spi, PinName cs, LCDType type = LCD16x2, LCDCtrl ctrl = HD44780);
+    TextLCD_SPI(SPI *spi, PinName cs, LCDType type = LCD16x2, LCDCtrl ctrl = HD44780, const LCDPinMap *map = NULL);
+
+#if(LCD_SPI_CHAIN == 1)
+    /** Create a TextLCD interface using an SPI 74595 portexpander in a daisy chain
+     *
+     * @param chain           Chain of expanders
+     * @param position        Position of the expander in the chain, 0 is nearest to the mbed
+     * @param type            Sets the panel size/addressing mode (default = LCD16x2)
+     * @param ctrl            LCD controller (default = HD44780)                     
+     * @param map             Pin mapping of the expander module (default = NULL, the module selected in TextLCD_Config.h)
+     */
+    TextLCD_SPI(TextLCD_SPI_Chain *chain, int position, LCDType type = LCD16x2, LCDCtrl ctrl = HD44780, const LCDPinMap *map = NULL);
+#endif
+
+   /** Destruct a TextLCD interface using an SPI 74595 portexpander
+     *
+     * @param  none
+     * @return none
+     */ 
+    virtual ~TextLCD_SPI();
 
 private:
+#if(LCD_SPI_CHAIN == 1)
+    friend class TextLCD_SPI_Chain;
+#endif
 
 /** Implementation of pure Virtual Low level writes to LCD Bus (serial expander)
   * Set the Enable pin.
@@ -864,13 +1796,62 @@ private:
   * Set the databus value (4 bit).
   */   
     virtual void _setData(int value);     
+
+/** Low level method to map the 4 bit data to the expander pins
+  * @return bus value
+  */
+    char _mapData(char bus, int value);
+
+/** Low level method to write the bus shadow value to the expander
+  */
+    void _writeBus();
+
+/** Low level method to encode a byte as the sequence of expander bus values for the Enable strobes
+  * @param int value         Byte to write
+  * @param char *frames      Encoded bus values
+  * @param int stride        Distance between encoded bus values
+  * @return Number of bus values
+  */
+    int _encodeByte(int value, char *frames, int stride);
+
+#if(LCD_SPI_BLOCK == 1)
+/** Low level writes to LCD serial bus expander, the Enable strobe frames are encoded in one pass
+  */
+    virtual void _writeByte(int value);   
+
+/** Low level method to write a sequence of bus values to the expander
+  * @param const char *frames  Bus values
+  * @param int nr_frames       Number of bus values
+  */
+    void _writeFrames(const char *frames, int nr_frames);
+#endif
+
+#if(LCD_SPI_CHAIN == 1)
+/** Low level method to encode a captured bus operation as a sequence of expander bus values
+  * @param const _LCDOp *op  Captured operation
+  * @param char *frames      Encoded bus values
+  * @param int stride        Distance between encoded bus values
+  * @return Number of bus values
+  */
+    int _encodeOp(const _LCDOp *op, char *frames, int stride);
+#endif
    
 // SPI bus        
     SPI *_spi;
     DigitalOut _cs;    
+    bool _hwcs;    // Chip select by SPI hardware
     
 // Internal bus shadow value for serial bus only
     char _lcd_bus;   
+
+// Expander pin mapping
+    _LCDExpander _exp;
+
+#if(LCD_SPI_CHAIN == 1)
+// Daisy chain, NULL for a single expander
+    TextLCD_SPI_Chain *_chain;
+    int _position;
+#endif
 };
 #endif /* SPI Expander SN74595          */
 //---------- End TextLCD_SPI ------------
@@ -891,13 +1872,22 @@ public:
      * @param type            Sets the panel size/addressing mode (default = LCD16x2)
      * @param bl              Backlight control line (optional, default = NC)       
      * @param ctrl            LCD controller (default = ST7032_3V3)                     
+     * @param frequency       Max I2C clock in Hz (default = 0, the fastest clock supported by the controller and LCD_I2C_MAX_HZ)
      */
-    TextLCD_I2C_N(I2C *i2c, char deviceAddress = ST7032_SA, LCDType type = LCD16x2, PinName bl = NC, LCDCtrl ctrl = ST7032_3V3);
+    TextLCD_I2C_N(I2C *i2c, char deviceAddress = ST7032_SA, LCDType type = LCD16x2, PinName bl = NC, LCDCtrl ctrl = ST7032_3V3, int frequency = 0);
 
   /** Destruct a TextLCD interface using a controller with native I2C interface
     */
     virtual ~TextLCD_I2C_N(void);
 
+   /** Find the fastest I2C clock that works for the controller
+     *  Test writes are sent at decreasing clocks, starting at the requested clock, until they are ACKed.
+     *
+     * @param frequency       Max I2C clock in Hz to test (default = 0, the fastest clock supported by the controller and LCD_I2C_MAX_HZ)
+     * @return                Selected I2C clock in Hz, 0 when the controller does not respond
+     */
+    int probeFrequency(int frequency = 0);
+
 private:
 
 /** Implementation of pure Virtual Low level writes to LCD Bus (serial native)
@@ -924,6 +1914,27 @@ private:
   */
     virtual void _writeByte(int value);
 
+/** Low level reads from LCD serial bus only (serial native)
+  */
+    virtual int _readByte();
+
+#if (LCD_I2C_RUN == 1)
+/** Low level write of a run of data bytes (serial native)
+  * The run is written in a single I2C frame after one controlbyte.
+  */
+    virtual void _writeDataRun(int command, const char *data, int len);
+#endif
+
+#if (LCD_PLAN == 1)
+/** Overhead of a data run on the bus
+  */
+    virtual int _runCost();
+#endif
+
+/** Max I2C clock in Hz of the controller
+  */
+    int _maxFrequency();
+
 //I2C bus
     I2C *_i2c;
     char _slaveAddress;
@@ -955,8 +1966,9 @@ public:
      * @param type            Sets the panel size/addressing mode (default = LCD16x2)
      * @param bl              Backlight control line (optional, default = NC)  
      * @param ctrl            LCD controller (default = ST7032_3V3)                     
+     * @param frequency       Max SPI clock in Hz (default = 0, the fastest clock supported by the controller and LCD_SPI_MAX_HZ)
      */
-    TextLCD_SPI_N(SPI *spi, PinName cs, PinName rs, LCDType type = LCD16x2, PinName bl = NC, LCDCtrl ctrl = ST7032_3V3);
+    TextLCD_SPI_N(SPI *spi, PinName cs, PinName rs, LCDType type = LCD16x2, PinName bl = NC, LCDCtrl ctrl = ST7032_3V3, int frequency = 0);
 
     /** Destruct a TextLCD interface using a controller with native SPI4 interface
       */
@@ -987,6 +1999,19 @@ private:
 /** Low level writes to LCD serial bus only (serial native)
   */
     virtual void _writeByte(int value);
+
+#if (LCD_SPI_RUN == 1)
+/** Low level write of a run of data bytes (serial native)
+  * RS is a separate pin, so the run is written with a single chip select.
+  */
+    virtual void _writeDataRun(int command, const char *data, int len);
+#endif
+
+#if (LCD_PLAN == 1)
+/** Overhead of a data run on the bus
+  */
+    virtual int _runCost();
+#endif
    
 // SPI bus        
     SPI *_spi;
@@ -1017,8 +2042,9 @@ public:
    * @param type            Sets the panel size/addressing mode (default = LCD16x2)
    * @param bl              Backlight control line (optional, default = NC)  
    * @param ctrl            LCD controller (default = ST7070) 
+   * @param frequency       Max SPI clock in Hz (default = 0, the fastest clock supported by the controller and LCD_SPI_MAX_HZ)
    */       
-  TextLCD_SPI_N_3_8(SPI *spi, PinName cs, LCDType type = LCD16x2, PinName bl = NC, LCDCtrl ctrl = ST7070);
+  TextLCD_SPI_N_3_8(SPI *spi, PinName cs, LCDType type = LCD16x2, PinName bl = NC, LCDCtrl ctrl = ST7070, int frequency = 0);
 
   /** Destruct a TextLCD interface using a controller with native SPI3_8 interface
     */
@@ -1083,8 +2109,9 @@ public:
      * @param type            Sets the panel size/addressing mode (default = LCD16x2)
      * @param bl              Backlight control line (optional, default = NC)  
      * @param ctrl            LCD controller (default = AIP31068)                     
+     * @param frequency       Max SPI clock in Hz (default = 0, the fastest clock supported by the controller and LCD_SPI_MAX_HZ)
      */
-    TextLCD_SPI_N_3_9(SPI *spi, PinName cs, LCDType type = LCD16x2, PinName bl = NC, LCDCtrl ctrl = AIP31068);
+    TextLCD_SPI_N_3_9(SPI *spi, PinName cs, LCDType type = LCD16x2, PinName bl = NC, LCDCtrl ctrl = AIP31068, int frequency = 0);
 
   /** Destruct a TextLCD interface using a controller with native SPI3_9 interface
     */
@@ -1115,6 +2142,19 @@ private:
 /** Low level writes to LCD serial bus only (serial native)
   */
     virtual void _writeByte(int value);
+
+#if (LCD_SPI3_PACK == 1)
+/** Low level write of a run of data bytes (serial native)
+  * The run is packed in one bitstream and written with a single chip select.
+  */
+    virtual void _writeDataRun(int command, const char *data, int len);
+#endif
+
+#if (LCD_PLAN == 1)
+/** Overhead of a data run on the bus
+  */
+    virtual int _runCost();
+#endif
    
 // SPI bus        
     SPI *_spi;
@@ -1147,8 +2187,9 @@ public:
      * @param type            Sets the panel size/addressing mode (default = LCD16x2)
      * @param bl              Backlight control line (optional, default = NC)  
      * @param ctrl            LCD controller (default = AIP31068)                     
+     * @param frequency       Max SPI clock in Hz (default = 0, the fastest clock supported by the controller and LCD_SPI_MAX_HZ)
      */
-    TextLCD_SPI_N_3_10(SPI *spi, PinName cs, LCDType type = LCD16x2, PinName bl = NC, LCDCtrl ctrl = AIP31068);
+    TextLCD_SPI_N_3_10(SPI *spi, PinName cs, LCDType type = LCD16x2, PinName bl = NC, LCDCtrl ctrl = AIP31068, int frequency = 0);
 
   /** Destruct a TextLCD interface using a controller with native SPI3_10 interface
     */
@@ -1179,6 +2220,23 @@ private:
 /** Low level writes to LCD serial bus only (serial native)
   */
     virtual void _writeByte(int value);
+
+#if (LCD_SPI3_PACK == 1)
+/** Low level write of a run of data bytes (serial native)
+  * The run is packed in one bitstream and written with a single chip select.
+  */
+    virtual void _writeDataRun(int command, const char *data, int len);
+#endif
+
+#if (LCD_PLAN == 1)
+/** Overhead of a data run on the bus
+  */
+    virtual int _runCost();
+#endif
+
+/** Low level reads from LCD serial bus only (serial native)
+  */
+    virtual int _readByte();
    
 // SPI bus        
     SPI *_spi;
@@ -1210,8 +2268,9 @@ public:
      * @param type            Sets the panel size/addressing mode (default = LCD16x2)
      * @param bl              Backlight control line (optional, default = NC)  
      * @param ctrl            LCD controller (default = PT6314)                     
+     * @param frequency       Max SPI clock in Hz (default = 0, the fastest clock supported by the controller and LCD_SPI_MAX_HZ)
      */
-    TextLCD_SPI_N_3_16(SPI *spi, PinName cs, LCDType type = LCD16x2, PinName bl = NC, LCDCtrl ctrl = PT6314);
+    TextLCD_SPI_N_3_16(SPI *spi, PinName cs, LCDType type = LCD16x2, PinName bl = NC, LCDCtrl ctrl = PT6314, int frequency = 0);
 
   /** Destruct a TextLCD interface using a controller with native SPI3_16 interface
     */
@@ -1242,6 +2301,23 @@ private:
 /** Low level writes to LCD serial bus only (serial native)
   */
     virtual void _writeByte(int value);
+
+#if (LCD_SPI3_PACK == 1)
+/** Low level write of a run of data bytes (serial native)
+  * The run is packed in one bitstream and written with a single chip select.
+  */
+    virtual void _writeDataRun(int command, const char *data, int len);
+#endif
+
+#if (LCD_PLAN == 1)
+/** Overhead of a data run on the bus
+  */
+    virtual int _runCost();
+#endif
+
+/** Low level reads from LCD serial bus only (serial native)
+  */
+    virtual int _readByte();
    
 // SPI bus        
     SPI *_spi;
@@ -1274,8 +2350,9 @@ public:
      * @param type            Sets the panel size/addressing mode (default = LCD16x2)
      * @param bl              Backlight control line (optional, default = NC)  
      * @param ctrl            LCD controller (default = SSD1803)                     
+     * @param frequency       Max SPI clock in Hz (default = 0, the fastest clock supported by the controller and LCD_SPI_MAX_HZ)
      */
-    TextLCD_SPI_N_3_24(SPI *spi, PinName cs, LCDType type = LCD16x2, PinName bl = NC, LCDCtrl ctrl = SSD1803_3V3);
+    TextLCD_SPI_N_3_24(SPI *spi, PinName cs, LCDType type = LCD16x2, PinName bl = NC, LCDCtrl ctrl = SSD1803_3V3, int frequency = 0);
 
   /** Destruct a TextLCD interface using a controller with native SPI3_24 interface
     */
@@ -1306,6 +2383,10 @@ private:
 /** Low level writes to LCD serial bus only (serial native)
   */
     virtual void _writeByte(int value);
+
+/** Low level reads from LCD serial bus only (serial native)
+  */
+    virtual int _readByte();
    
 // SPI bus        
     SPI *_spi;
@@ -1321,4 +2402,225 @@ private:
 //-------- End TextLCD_SPI_N_3_24 ----------
 
 
+//--------- Start TextLCD_Thread -----------
+#if(LCD_THREAD == 1) /* Thread-safe front end */
+#if !MBED_CONF_RTOS_PRESENT
+#error "TextLCD_Thread needs the mbed RTOS"
+#endif
+#if(LCD_SHADOW != 1)
+#error "TextLCD_Thread needs LCD_SHADOW"
+#endif
+
+/** Thread-safe front end for a TextLCD, all bus operations are done by a dedicated render thread
+  * Producers write characters into a frame buffer and post other updates into a bounded queue, they never wait for the bus.
+  * Characters that are written several times before the next render are coalesced and only the characters
+  * that differ from the display are written. The display must not be accessed directly once the front end is created.
+  *
+  * Example:
+  * @code
+  * TextLCD_I2C lcd(&i2c_lcd, 0x42, TextLCD::LCD20x4);  // I2C bus, PCF8574 Slaveaddress, LCD Type
+  * TextLCD_Thread lcd_t(&lcd);                          // Render thread for lcd
+  *
+  * lcd_t.write(0, 1, "Temp 21.5C");                     // Column, Row, Text. May be called from any thread
+  * @endcode
+  */
+class TextLCD_Thread {
+public:
+   /** Create a thread-safe front end and start the render thread
+     *
+     * @param lcd         Display, must be initialised
+     * @param queue_size  Max number of queued updates (default = LCD_THREAD_QUEUE)
+     */
+    TextLCD_Thread(TextLCD_Base *lcd, int queue_size = LCD_THREAD_QUEUE);
+
+   /** Destruct the front end, stops the render thread
+     *
+     * @param  none
+     * @return none
+     */
+    virtual ~TextLCD_Thread();
+
+   /** Write text at a screen location
+     * Text continues on the next row and is clipped at the end of the screen.
+     *
+     * @param column  The horizontal position from the left, indexed from 0
+     * @param row     The vertical position from the top, indexed from 0
+     * @param text    Characters to write
+     * @param len     Number of characters, -1 writes up to the terminating 0 (default)
+     * @return        Number of characters written
+     */
+    int write(int column, int row, const char *text, int len = -1);
+
+   /** Clear the screen
+     *
+     * @param  none
+     * @return none
+     */
+    void cls();
+
+   /** Queue a change of the display mode
+     *
+     * @param displayMode The Display mode (DispOff, DispOn)
+     * @return            false when the queue is full
+     */
+    bool setMode(TextLCD_Base::LCDMode displayMode);
+
+   /** Queue a change of the cursor mode
+     *
+     * @param cursorMode  The Cursor mode (CurOff_BlkOff, CurOn_BlkOff, CurOff_BlkOn, CurOn_BlkOn)
+     * @return            false when the queue is full
+     */
+    bool setCursor(TextLCD_Base::LCDCursor cursorMode);
+
+   /** Queue a change of the backlight
+     *
+     * @param backlightMode The Backlight mode (LightOff, LightOn)
+     * @return              false when the queue is full
+     */
+    bool setBacklight(TextLCD_Base::LCDBacklight backlightMode);
+
+   /** Queue a User Defined Character pattern
+     *
+     * @param c         The Index of the UDC (0..7) for HD44780 or clones and (0..15) for some more advanced controllers
+     * @param udc_data  The bitpatterns for the UDC (8 bytes of 5 significant bits), copied into the queue
+     * @return          false when the queue is full
+     */
+    bool setUDC(unsigned char c, char *udc_data);
+
+protected:
+   /** Queued update type
+     */
+    enum _Cmd_Type {
+        _Cmd_Mode,       /*<  setMode */
+        _Cmd_Cursor,     /*<  setCursor */
+        _Cmd_Backlight,  /*<  setBacklight */
+        _Cmd_UDC         /*<  setUDC */
+    };
+
+   /** Queued update
+     */
+    typedef struct {
+      unsigned char type;      // Update type (_Cmd_Type)
+      unsigned char value;     // Mode or UDC index
+      char data[8];            // UDC pattern
+    } _Cmd;
+
+/** Add an update to the queue and wake up the render thread
+  *  @return false when the queue is full
+  */
+    bool _post(int type, int value, const char *data);
+
+/** Render thread, applies the queued updates and writes the changed characters
+  */
+    void _run();
+
+//Display
+    TextLCD_Base *_lcd;
+    int _size;            // Number of characters on the screen
+
+//Screen content written by the producers and the copy used by the render thread
+    char *_frame;
+    char *_render;
+    bool _dirty;          // Frame was changed since the last render
+
+//Queued updates, ringbuffer
+    _Cmd *_queue;
+    _Cmd *_batch;         // Copy used by the render thread
+    int _queue_size, _queue_head, _queue_cnt;
+
+//Render thread
+    bool _running;
+    Mutex _mutex;         // Protects the frame and the queue
+    Thread _thread;
+};
+#endif /* Thread-safe front end */
+//---------- End TextLCD_Thread ------------
+
+
+//--------- Start TextLCD_Status -----------
+#if(LCD_STATUS == 1) /* ISR-safe status region */
+#if(LCD_SHADOW != 1)
+#error "TextLCD_Status needs LCD_SHADOW"
+#endif
+
+/** ISR-safe status region of a TextLCD
+  * A single producer (eg an interrupt handler) stores characters in a cell buffer, there are no locks or bus operations.
+  * The cells are stored with single byte writes followed by an update of a sequence counter.
+  * The consumer calls flush() from the context that owns the display to write the changed characters.
+  *
+  * Example:
+  * @code
+  * TextLCD lcd(p15, p16, p17, p18, p19, p20, TextLCD::LCD20x4); // rs, e, d4-d7
+  * TextLCD_Status status(&lcd, 0, 3, 20);                       // Display, Column, Row, Length
+  *
+  * void fault_isr() {
+  *   status.putHex(0, fault_code, 4);                           // Interrupt context
+  * }
+  *
+  * while(1) {
+  *   status.flush();                                            // Background
+  * }
+  * @endcode
+  */
+class TextLCD_Status {
+public:
+   /** Create a status region
+     * The region continues on the next row and is clipped at the end of the screen.
+     *
+     * @param lcd     Display
+     * @param column  The horizontal position from the left of the first cell, indexed from 0
+     * @param row     The vertical position from the top of the first cell, indexed from 0
+     * @param len     Number of cells
+     */
+    TextLCD_Status(TextLCD_Base *lcd, int column, int row, int len);
+
+   /** Destruct a status region
+     *
+     * @param  none
+     * @return none
+     */
+    virtual ~TextLCD_Status();
+
+   /** Store a character, may be called from interrupt context
+     *
+     * @param idx  Cell index in the region
+     * @param c    Character
+     * @return none
+     */
+    void put(int idx, char c);
+
+   /** Store a value as hexadecimal digits, may be called from interrupt context
+     *
+     * @param idx     Cell index in the region of the first digit
+     * @param value   Value
+     * @param digits  Number of digits
+     * @return none
+     */
+    void putHex(int idx, uint32_t value, int digits);
+
+   /** Write the changed cells to the display, call from the context that owns the display
+     *
+     * @param  none
+     * @return true when the region was written
+     */
+    bool flush();
+
+protected:
+//Display
+    TextLCD_Base *_lcd;
+    int _pos;                    // First cell in the screen shadow
+    int _len;                    // Number of cells
+
+//Cells written by the producer and the copy used by flush()
+    volatile char *_cells;
+    char *_copy;
+
+//Updated by the producer after storing cells, flush() writes when it differs from the last flushed value
+    volatile uint32_t _seq;
+    uint32_t _flushed;
+};
+#endif /* ISR-safe status region */
+//---------- End TextLCD_Status ------------
+
+
 #endif
@@ -34,6 +34,7 @@
 
 //Select hardware interface options to reduce memory footprint (multiple options allowed)
 #define LCD_I2C        1           /* I2C Expander PCF8574/MCP23008 */
+#define LCD_I2C16      1           /* I2C Expander MCP23017/PCF8575 with 8 bit databus */
 #define LCD_SPI        1           /* SPI Expander SN74595          */
 #define LCD_I2C_N      1           /* Native I2C bus     */
 #define LCD_SPI_N      1           /* Native SPI bus     */
@@ -55,6 +56,25 @@
 #define LCD_CONTRAST   1           /* Enable Contrast control implementation -0.9K codesize*/
 #define LCD_TWO_CTRL   1           /* Enable LCD40x4 (two controller) implementation -0.1K codesize*/
 #define LCD_FONTSEL    0           /* Enable runtime font select implementation using setFont -0.9K codesize*/
+#define LCD_GROUP      1           /* Enable interleaved init of multiple displays using initGroup -0.4K codesize*/
+#define LCD_SHADOW     1           /* Enable screen shadow for fast cls and partial updates -0.4K codesize, uses columns x rows bytes RAM*/
+#define LCD_CALIBRATE  1           /* Enable timing calibration using busy flag readback -0.5K codesize*/
+#define LCD_SLEEP      1           /* Enable sleep instead of spin wait during long delays -0.1K codesize*/
+#define LCD_THREAD     0           /* Enable thread-safe front end TextLCD_Thread, needs RTOS and LCD_SHADOW -0.7K codesize*/
+#define LCD_STATUS     1           /* Enable ISR-safe status region TextLCD_Status, needs LCD_SHADOW -0.3K codesize*/
+#define LCD_STEP       1           /* Enable queued bus operations executed by step() for cooperative schedulers -0.2K codesize*/
+#define LCD_BUSLOCK    1           /* Enable lock and unlock hooks to share the bus with other devices -0.1K codesize*/
+#define LCD_SPI_CHAIN  1           /* Enable daisy-chained SPI 74595 expanders for several displays, needs LCD_SPI -0.5K codesize*/
+#define LCD_SPI_BLOCK  1           /* Enable encoding of the strobe frames in one pass and skipping of unchanged RS writes for SPI 74595 expanders, needs LCD_SPI -0.1K codesize*/
+#define LCD_BUS8       1           /* Enable 8 bit databus for mbed pins and PortOut -0.3K codesize*/
+#define LCD_PORT       1           /* Enable PortOut bus with the databus, RS and E on one port, needs DEVICE_PORTOUT -0.2K codesize*/
+#define LCD_BYTE_TABLE 1           /* Enable 256 entry byte to databits tables for the I2C and SPI expanders -0.5K codesize each*/
+#define LCD_PINMAP     1           /* Enable runtime pin mappings for the I2C and SPI expanders using LCDPinMap -0.2K codesize, 0.5K RAM for each display with LCD_BYTE_TABLE*/
+#define LCD_TX         1           /* Enable merging of set address and data writes into single bus transactions, skips set address when not needed -0.4K codesize*/
+#define LCD_SPI_RUN    1           /* Enable data runs with a single chip select for native SPI4 (TextLCD_SPI_N), needs LCD_TX -0.2K codesize*/
+#define LCD_I2C_RUN    1           /* Enable data runs in a single I2C frame for native I2C (TextLCD_I2C_N), also without ACK, needs LCD_TX -0.2K codesize*/
+#define LCD_SPI3_PACK  1           /* Enable data runs packed in one bitstream for native SPI3 9, 10 and 16 bits (TextLCD_SPI_N_3_9/10/16), needs LCD_TX -0.3K codesize*/
+#define LCD_PLAN       1           /* Enable memory address ordered partial updates that rewrite short unchanged gaps instead of a set address, needs LCD_SHADOW -0.3K codesize*/
 
 //Select option to activate default fonttable or alternatively use conversion for specific controller versions (eg PCF2116C, PCF2119R, SSD1803, US2066)
 #define LCD_DEF_FONT   1           //Default HD44780 font
@@ -66,6 +86,8 @@
 //Pin Defines for I2C PCF8574/PCF8574A or MCP23008 and SPI 74595 bus expander interfaces
 //Different commercially available LCD portexpanders use different wiring conventions.
 //LCD and serial portexpanders should be wired according to the tables below.
+//The selected module is the default for all displays. Other modules may be selected for each display
+//by passing one of the TextLCD::PinMap_xxx mappings to the constructor (see LCD_PINMAP).
 //
 //Select Serial Port Expander Hardware module (one option only)
 #define DEFAULT        0
@@ -445,6 +467,39 @@
 #endif
 
 
+//Pin Defines for I2C MCP23017/PCF8575 16 bit bus expander interface
+//The LCD is used with an 8 bit databus. LCD and portexpander should be wired according to the table below,
+//any other mapping of expander portpins to LCD pins may be selected.
+//
+//Select I2C 16 bit Port Expander Hardware (one option only)
+#define MCP23017       1
+#define PCF8575        0
+
+//I2C 16 bit bus expander (MCP23017 or PCF8575) interface
+//Port A (GPA0..GPA7 or P00..P07) to the LCD databus, Port B (GPB0..GPB4 or P10..P14) to the LCD controls 
+#define LCD_BUS_I2C16_D0 (1 << 0)
+#define LCD_BUS_I2C16_D1 (1 << 1)
+#define LCD_BUS_I2C16_D2 (1 << 2)
+#define LCD_BUS_I2C16_D3 (1 << 3)
+#define LCD_BUS_I2C16_D4 (1 << 4)
+#define LCD_BUS_I2C16_D5 (1 << 5)
+#define LCD_BUS_I2C16_D6 (1 << 6)
+#define LCD_BUS_I2C16_D7 (1 << 7)
+#define LCD_BUS_I2C16_RS (1 << 8)
+#define LCD_BUS_I2C16_RW (1 << 9)
+#define LCD_BUS_I2C16_E  (1 << 10)
+#define LCD_BUS_I2C16_E2 (1 << 11)
+#define LCD_BUS_I2C16_BL (1 << 12)
+
+//Bitpattern Defines for I2C MCP23017/PCF8575 Bus expanders
+//Don't change!
+#if (BACKLIGHT_INV == 1)
+#define LCD_BUS_I2C16_DEF (0x0000 | LCD_BUS_I2C16_BL)
+#else
+#define LCD_BUS_I2C16_DEF  0x0000
+#endif
+
+
 /* PCF8574/PCF8574A I2C portexpander slave address */
 #define PCF8574_SA0    0x40
 #define PCF8574_SA1    0x42
@@ -487,6 +542,33 @@
 #define GPIO           0x09
 #define OLAT           0x0A
 
+/* MCP23017 I2C portexpander slave address */
+#define MCP23017_SA0   0x40
+#define MCP23017_SA1   0x42
+#define MCP23017_SA2   0x44
+#define MCP23017_SA3   0x46
+#define MCP23017_SA4   0x48
+#define MCP23017_SA5   0x4A
+#define MCP23017_SA6   0x4C
+#define MCP23017_SA7   0x4E
+
+/* PCF8575 I2C portexpander slave address */
+#define PCF8575_SA0    0x40
+#define PCF8575_SA1    0x42
+#define PCF8575_SA2    0x44
+#define PCF8575_SA3    0x46
+#define PCF8575_SA4    0x48
+#define PCF8575_SA5    0x4A
+#define PCF8575_SA6    0x4C
+#define PCF8575_SA7    0x4E
+
+/* MCP23017 I2C portexpander internal registers (IOCON.BANK = 0) */
+#define MCP23017_IODIRA 0x00
+#define MCP23017_IODIRB 0x01
+#define MCP23017_IOCON  0x0A
+#define MCP23017_GPIOA  0x12
+#define MCP23017_GPIOB  0x13
+
 /* ST7032i I2C slave address */
 #define ST7032_SA      0x7C
 
@@ -526,10 +608,54 @@
 #define SPLC792A_SA2   0x7C
 #define SPLC792A_SA3   0x7E
 
+//Initial number of bus operations captured for each display by initGroup().
+//The largest init sequence (US2066) needs about 50 operations. The buffer grows for longer sequences, see LCD_STEP_MAX.
+#define LCD_INIT_OPS   64
+
+//Initial number of queued bus operations in step mode, see setStepMode(). Uses 4 bytes RAM for each operation.
+//A full redraw of a 20x4 display needs about 90 operations. The queue is at least sized for a full redraw of the display
+//and grows when it is full, up to LCD_STEP_MAX operations. Updates that do not fit block until the oldest operations are written.
+#define LCD_STEP_OPS   128
+#define LCD_STEP_MAX   1024
+
+//Default max time in us that update() holds the bus lock before it yields to other devices, see setBusLock().
+#define LCD_BUS_HOLD   2000
+
+//Setup, hold and Enable pulse time in ns for the parallel bus. The HD44780 needs 450ns Enable pulse width and 1000ns Enable cycle time at 3V3.
+//The delay is a busy loop based on SystemCoreClock.
+#define LCD_BUS_NS     500
+
+//Delays of at least this many us will sleep instead of spin wait, see setSleep().
+//Uses ThisThread::sleep_for() when the RTOS is present, otherwise sleep() until a Timeout expires.
+#define LCD_SLEEP_US   2000
+
+//Number of queued updates (UDC, mode, cursor, backlight) and stack size in bytes of the TextLCD_Thread render thread.
+#define LCD_THREAD_QUEUE   8
+#define LCD_THREAD_STACK   1024
+
 //Some native I2C controllers dont support ACK. Set define to '0' to allow code to proceed even without ACK
 //#define LCD_I2C_ACK    0
 #define LCD_I2C_ACK    1
 
+//Max I2C clock in Hz supported by the board (pullups, wiring length). The I2C clock is the lowest of this value,
+//the max clock of the expander or controller and the optional frequency passed to the constructor.
+//Reduce to 100000 for long wires or weak pullups, or use probeFrequency() to find a working clock.
+#define LCD_I2C_MAX_HZ      400000
+
+//Max I2C clock in Hz of the portexpanders. The MCP23008/MCP23017 support 1.7MHz in HS mode,
+//which needs a master code that is not supported by the mbed I2C API.
+#define PCF8574_MAX_HZ      100000
+#define MCP23008_MAX_HZ     400000
+#define PCF8575_MAX_HZ      400000
+#define MCP23017_MAX_HZ     400000
+
+//Number of writes that must be ACKed at each I2C clock tested by probeFrequency()
+#define LCD_I2C_PROBE       3
+
+//Max SPI clock in Hz supported by the board (wiring length) for the native SPI controllers. The SPI clock is the lowest
+//of this value, the max clock of the controller and the optional frequency passed to the constructor.
+#define LCD_SPI_MAX_HZ      4000000
+
 
 // Contrast setting, 6 significant bits (only supported for controllers with extended features)
 // Voltage Multiplier setting, 2 or 3 significant bits (only supported for controllers with extended features)